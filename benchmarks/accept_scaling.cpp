@@ -0,0 +1,72 @@
+// g++ -std=c++17 -O2 -pthread -I.. accept_scaling.cpp -o accept_scaling && ./accept_scaling [max services]
+// connections accepted per second by a service_pool of 1, 2, 4, ... services
+// with SO_REUSEPORT listeners; as many connector threads as services open
+// and reset loopback connections for a second
+#include <netutils.hpp>
+#include <arpa/inet.h>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+using namespace util::net;
+
+void connect_loop(int _port, std::atomic<bool> &_running)
+{
+    sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(_port);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    while(_running.load(std::memory_order_relaxed))
+    {
+        int connection = ::socket(AF_INET, SOCK_STREAM, 0);
+        if(::connect(connection, (sockaddr*)&address, sizeof(address)) == 0)
+        {
+            // a reset leaves no TIME_WAIT behind that would use up local ports
+            linger reset = { 1, 0 };
+            ::setsockopt(connection, SOL_SOCKET, SO_LINGER, &reset, sizeof(reset));
+        }
+        ::close(connection);
+    }
+}
+
+double connections_per_second(unsigned int _services, int _port)
+{
+    std::atomic<std::uint64_t> accepted(0);
+    service_pool pool(_services);
+    pool.listen(_port, [&](server &_server, bool _success) {
+        if(_success)
+            _server.accept();
+        accepted.fetch_add(1, std::memory_order_relaxed);
+    });
+    pool.run();
+
+    std::atomic<bool> running(true);
+    std::vector<std::thread> connectors;
+    for(unsigned int i = 0; i < _services; i++)
+        connectors.emplace_back([&]() { connect_loop(_port, running); });
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    std::uint64_t before = accepted.load();
+    auto start = std::chrono::steady_clock::now();
+    std::this_thread::sleep_for(std::chrono::seconds(1));
+    std::uint64_t count = accepted.load() - before;
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    running = false;
+    for(auto &connector : connectors)
+        connector.join();
+    return count / seconds;
+}
+
+int main(int _argc, char **_argv)
+{
+    unsigned int cores = std::max(std::thread::hardware_concurrency(), 1u);
+    unsigned int limit = _argc > 1 ? std::atoi(_argv[1]) : cores;
+    int port = 20000 + getpid() % 20000;
+    std::printf("%u cores\n%-10s %14s\n", cores, "services", "connections/s");
+    for(unsigned int services = 1; services <= limit; services *= 2)
+        std::printf("%-10u %14.0f\n", services, connections_per_second(services, port++));
+    return 0;
+}
@@ -0,0 +1,84 @@
+// g++ -std=c++17 -O2 -pthread -I.. client_pipelining.cpp -o client_pipelining && ./client_pipelining
+// small-message pipelining over loopback: one send() system call per
+// message, as write()/write_async() do, against client::send(), which
+// queues the messages and flushes them together once the socket is writable
+#include <netutils.hpp>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <thread>
+#include <unistd.h>
+
+using namespace util::net;
+
+const std::size_t messages = 1000000;
+
+// the receiving end drains on its own thread with plain recv()
+std::thread drain(util::net::socket _socket, std::size_t _bytes)
+{
+    return std::thread([=]() {
+        char buffer[65536];
+        std::size_t received = 0;
+        while(received < _bytes)
+        {
+            auto result = ::recv(_socket, buffer, sizeof(buffer), 0);
+            if(result <= 0)
+                break;
+            received += result;
+        }
+        ::close(_socket);
+    });
+}
+
+template<class Sender>
+double messages_per_second(int _port, std::size_t _size, Sender &&_sender)
+{
+    service events;
+    server listener(events, _port);
+    listener.configure();
+    std::unique_ptr<client> peer;
+    listener.accept_async([&](server &_server, bool) { peer.reset(new client(_server.accept())); });
+    client connection(events);
+    if(!connection.connect("127.0.0.1", _port))
+        return 0;
+    while(!peer)
+        events.do_poll(50);
+    util::net::socket receiving = peer->release();
+    make_blocking(receiving);
+
+    auto start = std::chrono::steady_clock::now();
+    std::thread receiver = drain(receiving, messages * _size);
+    _sender(events, connection, _size);
+    receiver.join();
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return messages / seconds;
+}
+
+int main()
+{
+    int port = 20000 + getpid() % 20000;
+    char message[256] = {};
+    std::printf("%-12s %16s %16s\n", "msg/s", "send() each", "client::send()");
+    for(std::size_t size : { 16, 64, 256 })
+    {
+        double each = messages_per_second(port++, size, [&](service&, client &_connection, std::size_t _size) {
+            for(std::size_t i = 0; i < messages; i++)
+                _connection.write(message, _size);
+        });
+        double queued = messages_per_second(port++, size, [&](service &_events, client &_connection, std::size_t _size) {
+            for(std::size_t i = 0; i < messages; i++)
+            {
+                _connection.send(message, _size);
+                // let the writer run now and then, as a busy service would
+                if(i % 256 == 255)
+                    _events.do_poll(0);
+            }
+            bool flushed = false;
+            _connection.flush_async([&](client&, bool) { flushed = true; });
+            while(!flushed)
+                _events.do_poll(10);
+        });
+        std::printf("%-12s %16.0f %16.0f\n", (std::to_string(size) + " bytes").c_str(), each, queued);
+    }
+    return 0;
+}
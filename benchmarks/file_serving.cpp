@@ -0,0 +1,115 @@
+// g++ -std=c++17 -O2 -pthread -I.. file_serving.cpp -o file_serving && ./file_serving [megabytes]
+// serves a file over loopback: read through util::file::open_readable and
+// client::write() as before, send_file() and write_file_async(). Reports
+// GB/s and the CPU time the serving thread spent per GB (Linux only)
+#include <netutils.hpp>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <memory>
+#include <thread>
+#include <sys/resource.h>
+#include <unistd.h>
+
+using namespace util::net;
+
+double thread_cpu_seconds()
+{
+    rusage usage;
+    getrusage(RUSAGE_THREAD, &usage);
+    return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+}
+
+struct result
+{
+    double gigabytes_per_second;
+    double cpu_seconds_per_gigabyte;
+};
+
+template<class Sender>
+result serve(int _port, std::size_t _size, Sender &&_sender)
+{
+    service events;
+    server listener(events, _port);
+    listener.configure();
+    std::unique_ptr<client> peer;
+    listener.accept_async([&](server &_server, bool) { peer.reset(new client(_server.accept())); });
+    client connection(events);
+    if(!connection.connect("127.0.0.1", _port))
+        return result{0, 0};
+    while(!peer)
+        events.do_poll(50);
+    util::net::socket receiving = peer->release();
+    make_blocking(receiving);
+    std::thread receiver([=]() {
+        static char buffer[1 << 20];
+        std::size_t received = 0;
+        while(received < _size)
+        {
+            auto count = ::recv(receiving, buffer, sizeof(buffer), 0);
+            if(count <= 0)
+                break;
+            received += count;
+        }
+        ::close(receiving);
+    });
+
+    double cpu = thread_cpu_seconds();
+    auto start = std::chrono::steady_clock::now();
+    _sender(events, connection);
+    receiver.join();
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    double gigabytes = _size / 1e9;
+    return result{gigabytes / seconds, (thread_cpu_seconds() - cpu) / gigabytes};
+}
+
+int main(int _argc, char **_argv)
+{
+    std::size_t size = (std::size_t)(_argc > 1 ? std::atoi(_argv[1]) : 512) << 20;
+    const char *path = "file_serving.data";
+    {
+        std::ofstream file(path, std::ios::binary);
+        std::string block(1 << 20, 'x');
+        for(std::size_t written = 0; written < size; written += block.size())
+            file.write(block.data(), block.size());
+    }
+    int port = 20000 + getpid() % 20000;
+
+    result streamed = serve(port++, size, [&](service&, client &_connection) {
+        util::file::handle file;
+        util::file::open_readable(file, path, std::ios::in | std::ios::binary);
+        static char buffer[65536];
+        while(file.read(buffer, sizeof(buffer)) || file.gcount() > 0)
+        {
+            const char *data = buffer;
+            std::size_t left = file.gcount();
+            while(left > 0)
+            {
+                int sent = _connection.write(data, left);
+                if(sent <= 0)
+                    return;
+                data += sent;
+                left -= sent;
+            }
+        }
+    });
+    result blocking = serve(port++, size, [&](service&, client &_connection) {
+        util::file::descriptor file = util::file::open_descriptor(path);
+        _connection.send_file(file, 0, size);
+        util::file::close_descriptor(file);
+    });
+    result queued = serve(port++, size, [&](service &_events, client &_connection) {
+        bool done = false;
+        _connection.write_file_async(path, [&](client&, std::int64_t) { done = true; });
+        while(!done)
+            _events.do_poll(10);
+    });
+    std::remove(path);
+
+    std::printf("%-20s %10s %12s\n", "", "GB/s", "CPU s/GB");
+    std::printf("%-20s %10.2f %12.3f\n", "fstream + write()", streamed.gigabytes_per_second, streamed.cpu_seconds_per_gigabyte);
+    std::printf("%-20s %10.2f %12.3f\n", "send_file()", blocking.gigabytes_per_second, blocking.cpu_seconds_per_gigabyte);
+    std::printf("%-20s %10.2f %12.3f\n", "write_file_async()", queued.gigabytes_per_second, queued.cpu_seconds_per_gigabyte);
+    return 0;
+}
@@ -0,0 +1,109 @@
+// g++ -std=c++17 -O2 -pthread -I.. pool_latency.cpp -o pool_latency && ./pool_latency
+// request latency against a local echo server, with a fresh connection per
+// request against connections reused through connection_pool
+#include <netutils.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+using namespace util::net;
+
+const int requests = 5000;
+const int message_size = 32;
+
+// echoes whatever arrives, on its own thread until stopped
+class echo_server
+{
+public:
+    echo_server(int _port)
+        : mListener(mEvents, _port)
+    {
+        mListener.configure();
+        mAccept = [this](server &_server, bool _success) {
+            if(!_success)
+                return;
+            mPeers.emplace_back(new client(_server.accept()));
+            mPeers.back()->receive([](client &_client, int _count) {
+                if(_count <= 0)
+                    return _client.close();
+                char buffer[4096];
+                while(!_client.received().empty())
+                    _client.send(buffer, (int)_client.received().read(buffer, sizeof(buffer)));
+            });
+            mListener.accept_async(mAccept);
+        };
+        mListener.accept_async(mAccept);
+        mThread = std::thread([this]() { mEvents.run(); });
+    }
+    ~echo_server()
+    {
+        mEvents.stop();
+        mThread.join();
+    }
+private:
+    service mEvents;
+    server mListener;
+    std::function<void(server&,bool)> mAccept;
+    std::vector<std::unique_ptr<client>> mPeers;
+    std::thread mThread;
+};
+
+void report(const char *_name, std::vector<double> &_latencies)
+{
+    std::sort(_latencies.begin(), _latencies.end());
+    std::printf("%-12s %10.1f %10.1f\n", _name, _latencies[_latencies.size() / 2], _latencies[_latencies.size() * 99 / 100]);
+}
+
+int main()
+{
+    int port = 20000 + getpid() % 20000;
+    echo_server echo(port);
+    service events;
+    char message[message_size] = {}, buffer[message_size];
+    std::vector<double> unpooled, pooled;
+
+    for(int i = 0; i < requests; i++)
+    {
+        auto start = std::chrono::steady_clock::now();
+        bool done = false;
+        client connection(events);
+        connection.connect_async("127.0.0.1", port, [&](client &_connection, bool _success) {
+            if(!_success)
+                std::abort();
+            _connection.write(message, message_size);
+            _connection.read_async(buffer, message_size, [&](client&, int) { done = true; });
+        });
+        while(!done)
+            events.do_poll(10);
+        connection.close();
+        unpooled.push_back(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count());
+    }
+
+    connection_pool pool(events);
+    for(int i = 0; i < requests; i++)
+    {
+        auto start = std::chrono::steady_clock::now();
+        bool done = false;
+        connection_pool::connection held;
+        pool.acquire("127.0.0.1", port, [&](connection_pool::connection _connection) {
+            if(!_connection)
+                std::abort();
+            held = std::move(_connection);
+            held->write(message, message_size);
+            held->read_async(buffer, message_size, [&](client&, int) { done = true; });
+        });
+        while(!done)
+            events.do_poll(10);
+        pool.release(std::move(held));
+        pooled.push_back(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count());
+    }
+
+    std::printf("%-12s %10s %10s\n", "us", "p50", "p99");
+    report("unpooled", unpooled);
+    report("pooled", pooled);
+    return 0;
+}
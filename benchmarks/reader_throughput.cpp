@@ -0,0 +1,123 @@
+// g++ -std=c++17 -O2 -I.. reader_throughput.cpp -o reader_throughput && ./reader_throughput [megabytes]
+// parse::reader throughput in MB/s for the read_string, read_integer and
+// skip_whitespace paths, reading from a string stream, a file through
+// std::ifstream and through a memory mapping, and from memory; then a
+// get() loop with eager and with lazy line/column tracking
+#include <parseutils.hpp>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+typedef std::string (*generator)(std::size_t);
+
+// quoted strings of 40-80 characters
+std::string strings(std::size_t _size)
+{
+	std::string text;
+	for(std::size_t i = 0; text.size() < _size; i++)
+		text += "\"" + std::string(40 + i % 41, 'a' + i % 26) + "\"\n";
+	return text;
+}
+
+// integers separated by single spaces
+std::string integers(std::size_t _size)
+{
+	std::string text;
+	for(std::size_t i = 0; text.size() < _size; i++)
+		text += std::to_string(i * 7919 % 100000007) + (i % 16 == 15 ? "\n" : " ");
+	return text;
+}
+
+// short integers between runs of blanks
+std::string whitespace(std::size_t _size)
+{
+	const char *gaps[] = { " ", "\t\t", "    ", "\n  \t", "        \n" };
+	std::string text;
+	for(std::size_t i = 0; text.size() < _size; i++)
+		text += std::to_string(i % 10) + gaps[i % 5];
+	return text;
+}
+
+std::size_t parse(util::parse::reader &_reader)
+{
+	std::size_t checksum = 0;
+	while(!_reader.skip_whitespace(true)) {
+		if(_reader.peek() == '\"')
+			checksum += _reader.read_string().size();
+		else
+			checksum += _reader.read_integer().size();
+	}
+	return checksum;
+}
+
+std::size_t get_all(util::parse::reader &_reader)
+{
+	std::size_t checksum = 0;
+	while(!_reader.eof())
+		checksum += (unsigned char)_reader.get();
+	return checksum;
+}
+
+template<class Source>
+double megabytes_per_second(const std::string &_text, Source &&_source)
+{
+	double best = 0;
+	for(int run = 0; run < 3; run++) {
+		auto start = std::chrono::steady_clock::now();
+		std::size_t checksum = _source(_text);
+		double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		if(checksum == 0)
+			std::abort();
+		best = std::max(best, _text.size() / seconds / (1 << 20));
+	}
+	return best;
+}
+
+int main(int _argc, char **_argv)
+{
+	std::size_t size = (_argc > 1 ? std::atoi(_argv[1]) : 64) << 20;
+	struct { const char *name; generator make; } inputs[] = {
+		{ "read_string", strings }, { "read_integer", integers }, { "skip_whitespace", whitespace }
+	};
+	const char *path = "reader_throughput.data";
+	std::printf("%-16s %10s %10s %10s %10s\n", "path", "stream", "ifstream", "mapped", "memory");
+	for(auto &input : inputs) {
+		std::string text = input.make(size);
+		std::ofstream(path, std::ios::binary).write(text.data(), text.size());
+		double stream = megabytes_per_second(text, [](const std::string &_text) {
+			std::istringstream in(_text);
+			util::parse::reader reader(in);
+			return parse(reader);
+		});
+		double file = megabytes_per_second(text, [=](const std::string&) {
+			std::ifstream in(path, std::ios::binary);
+			util::parse::reader reader(in);
+			return parse(reader);
+		});
+		double mapped = megabytes_per_second(text, [=](const std::string&) {
+			util::parse::reader reader{util::file::mapping(path)};
+			return parse(reader);
+		});
+		double memory = megabytes_per_second(text, [](const std::string &_text) {
+			util::parse::reader reader(_text.data(), _text.size());
+			return parse(reader);
+		});
+		std::printf("%-16s %10.1f %10.1f %10.1f %10.1f\n", input.name, stream, file, mapped, memory);
+	}
+	std::remove(path);
+	
+	std::string text = strings(size) + integers(size) + whitespace(size);
+	std::printf("\n%-16s %10s %10s\n", "get() loop", "eager", "lazy");
+	double timings[2];
+	for(int lazy = 0; lazy < 2; lazy++)
+		timings[lazy] = megabytes_per_second(text, [=](const std::string &_text) {
+			util::parse::reader reader(_text.data(), _text.size());
+			reader.lazy_positions(lazy == 1);
+			return get_all(reader) + reader.linenumber();
+		});
+	std::printf("%-16s %10.1f %10.1f\n", "memory", timings[0], timings[1]);
+	return 0;
+}
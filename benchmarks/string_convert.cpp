@@ -0,0 +1,76 @@
+// g++ -std=c++17 -O2 -I.. string_convert.cpp -o string_convert && ./string_convert
+// util::string::to/from per numeric type in ns per call, next to the
+// stringstream round trip they used to make
+#include <stringutils.hpp>
+#include <chrono>
+#include <cstdio>
+#include <sstream>
+#include <string>
+#include <vector>
+
+const int iterations = 1000000;
+
+template<typename T>
+std::vector<T> values()
+{
+    std::vector<T> result;
+    for(int i = 0; i < 1024; i++)
+        result.push_back((T)((i * 2654435761u) % 1000000) / (std::is_floating_point<T>::value ? (T)7 : (T)1));
+    return result;
+}
+
+template<class Body>
+double nanoseconds(Body &&_body)
+{
+    double best = 1e300;
+    for(int run = 0; run < 3; run++)
+    {
+        auto start = std::chrono::steady_clock::now();
+        std::size_t checksum = 0;
+        for(int i = 0; i < iterations; i++)
+            checksum += _body(i);
+        double elapsed = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+        if(checksum == 1)
+            std::printf(" ");
+        best = std::min(best, elapsed / iterations);
+    }
+    return best;
+}
+
+template<typename T>
+void measure(const char *_name)
+{
+    std::vector<T> numbers = values<T>();
+    std::vector<std::string> texts;
+    for(T number : numbers)
+        texts.push_back(util::string::from(number));
+
+    double from = nanoseconds([&](int _i) { return util::string::from(numbers[_i & 1023]).size(); });
+    double from_stream = nanoseconds([&](int _i)
+    {
+        std::stringstream convert;
+        convert << numbers[_i & 1023];
+        return convert.str().size();
+    });
+    double to = nanoseconds([&](int _i) { return (std::size_t)util::string::to<T>(texts[_i & 1023]); });
+    double to_stream = nanoseconds([&](int _i)
+    {
+        std::stringstream convert(texts[_i & 1023]);
+        T result;
+        convert >> result;
+        return (std::size_t)result;
+    });
+    std::printf("%-20s %10.1f %10.1f %10.1f %10.1f\n", _name, from, from_stream, to, to_stream);
+}
+
+int main()
+{
+    std::printf("%-20s %10s %10s %10s %10s\n", "ns per call", "from", "stream", "to", "stream");
+    measure<int>("int");
+    measure<unsigned int>("unsigned int");
+    measure<long long>("long long");
+    measure<unsigned long long>("unsigned long long");
+    measure<float>("float");
+    measure<double>("double");
+    return 0;
+}
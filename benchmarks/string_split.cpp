@@ -0,0 +1,116 @@
+// g++ -std=c++17 -O2 -I.. string_split.cpp -o string_split && ./string_split
+// util::string::split against the lazy split_view on a 200-field log line,
+// then the tokenizer's throughput in GB/s on 64 MB of CSV and TSV
+#include <stringutils.hpp>
+#include <chrono>
+#include <cstdio>
+#include <string>
+
+template<class Body>
+double microseconds(int _iterations, Body &&_body)
+{
+    double best = 1e300;
+    for(int run = 0; run < 3; run++)
+    {
+        auto start = std::chrono::steady_clock::now();
+        std::size_t checksum = 0;
+        for(int i = 0; i < _iterations; i++)
+            checksum += _body();
+        double elapsed = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+        if(checksum == 1)
+            std::printf(" ");
+        best = std::min(best, elapsed / _iterations);
+    }
+    return best;
+}
+
+// 200 fields of about 20 characters, some of them empty
+std::string log_line(const std::string &_separator)
+{
+    std::string line;
+    for(int i = 0; i < 200; i++)
+    {
+        if(i > 0)
+            line += _separator;
+        if(i % 10 != 9)
+            line += "field-" + std::to_string(i * 7919) + std::string(i % 12, 'x');
+    }
+    return line;
+}
+
+void measure(const char *_name, const std::string &_separator)
+{
+    std::string line = log_line(_separator);
+    double split = microseconds(20000, [&]()
+    {
+        std::size_t total = 0;
+        for(const std::string &token : util::string::split(line, _separator))
+            total += token.size();
+        return total;
+    });
+    double view = microseconds(20000, [&]()
+    {
+        std::size_t total = 0;
+        for(std::string_view token : util::string::split_view(line, _separator))
+            total += token.size();
+        return total;
+    });
+    std::printf("%-20s %8zu %10.2f %10.2f %8.1fx\n", _name, line.size(), split, view, split / view);
+}
+
+// rows of short fields; with _quote every fourth field is quoted and holds
+// a delimiter and a doubled quote
+std::string table(char _delimiter, char _quote)
+{
+    std::string text;
+    for(int row = 0; text.size() < (64u << 20); row++)
+    {
+        for(int field = 0; field < 12; field++)
+        {
+            if(field > 0)
+                text += _delimiter;
+            if(_quote != '\0' && field % 4 == 3)
+                text += std::string(1, _quote) + "say " + _quote + _quote + "hi" + _quote + _quote + _delimiter + " " + std::to_string(row) + _quote;
+            else
+                text += std::to_string(row * 31 + field);
+        }
+        text += '\n';
+    }
+    return text;
+}
+
+void measure_tokenizer(const char *_name, const std::string &_text, const util::string::tokenizer &_tokenizer)
+{
+    static std::size_t ends[4096];
+    double best = 0;
+    std::size_t fields = 0;
+    for(int run = 0; run < 3; run++)
+    {
+        auto start = std::chrono::steady_clock::now();
+        std::string_view rest(_text);
+        fields = 0;
+        for(;;)
+        {
+            std::size_t count = _tokenizer.tokenize(rest, ends, 4096);
+            fields += count;
+            if(count < 4096 || ends[count - 1] >= rest.size())
+                break;
+            rest.remove_prefix(ends[count - 1] + 1);
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        best = std::max(best, _text.size() / seconds / 1e9);
+    }
+    std::printf("%-20s %10zu %10.2f\n", _name, fields, best);
+}
+
+int main()
+{
+    std::printf("%-20s %8s %10s %10s %9s\n", "us per line", "bytes", "split", "split_view", "speedup");
+    measure("separator ','", ",");
+    measure("separator \", \"", ", ");
+    
+    std::printf("\n%-20s %10s %10s\n", "tokenizer", "fields", "GB/s");
+    measure_tokenizer("csv, quoted", table(',', '"'), util::string::tokenizer(",\n", '"'));
+    measure_tokenizer("tsv", table('\t', '\0'), util::string::tokenizer("\t\n"));
+    return 0;
+}
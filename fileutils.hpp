@@ -2,11 +2,21 @@
 
 #include <fstream>
 #include <string>
+#include <cstdint>
+#include <utility>
 
 #if defined(_WIN32) || defined(_WIN64)
     #include <direct.h>
+    #include <io.h>
+    #include <fcntl.h>
+    #include <sys/stat.h>
 #else
+    #include <sys/mman.h>
     #include <sys/stat.h>
+    #include <fcntl.h>
+    #include <unistd.h>
+
+    #define UTIL_FILE_HAS_MMAP
 #endif
 
 namespace util
@@ -14,6 +24,11 @@ namespace util
     namespace file
     {
         typedef std::fstream handle;
+        // raw operating system file, for APIs that bypass the stream buffers
+        // (e.g. util::net::client::write_file_async)
+        typedef int descriptor;
+        
+        const descriptor invalid_descriptor = -1;
         
         inline bool exists(const std::string &_path)
         {
@@ -56,6 +71,106 @@ namespace util
         {
             return open(_stream, _path, _mode);
         }
+        
+        inline descriptor open_descriptor(const std::string &_path)
+        {
+        #if defined(_WIN32) || defined(_WIN64)
+            return _open(_path.c_str(), _O_RDONLY | _O_BINARY);
+        #else
+            return ::open(_path.c_str(), O_RDONLY | O_CLOEXEC);
+        #endif
+        }
+        
+        inline void close_descriptor(descriptor _file)
+        {
+        #if defined(_WIN32) || defined(_WIN64)
+            _close(_file);
+        #else
+            ::close(_file);
+        #endif
+        }
+        
+        // -1 when the size cannot be determined
+        inline std::int64_t size(descriptor _file)
+        {
+        #if defined(_WIN32) || defined(_WIN64)
+            struct _stat64 info;
+            if(_fstat64(_file, &info) != 0)
+                return -1;
+        #else
+            struct stat info;
+            if(fstat(_file, &info) != 0)
+                return -1;
+        #endif
+            return (std::int64_t)info.st_size;
+        }
+        
+    #ifdef UTIL_FILE_HAS_MMAP
+        // read-only, private mapping of a whole file
+        class mapping
+        {
+        public:
+            inline mapping()
+                : mData(nullptr), mSize(0), mOpen(false) {}
+            inline mapping(const std::string &_path, bool _sequential=true)
+                : mapping() { open(_path, _sequential); }
+            inline mapping(mapping &&_other)
+                : mData(_other.mData), mSize(_other.mSize), mOpen(_other.mOpen) {
+                _other.mData = nullptr;
+                _other.mSize = 0;
+                _other.mOpen = false;
+            }
+            inline mapping &operator=(mapping &&_other) {
+                if(this != &_other) {
+                    close();
+                    std::swap(mData, _other.mData);
+                    std::swap(mSize, _other.mSize);
+                    std::swap(mOpen, _other.mOpen);
+                }
+                return *this;
+            }
+            mapping(const mapping&) = delete;
+            mapping &operator=(const mapping&) = delete;
+            inline ~mapping() { close(); }
+            
+            // _sequential tells the kernel to read ahead aggressively and
+            // drop pages behind the reader
+            inline bool open(const std::string &_path, bool _sequential=true) {
+                close();
+                descriptor source = open_descriptor(_path);
+                if(source == invalid_descriptor)
+                    return false;
+                std::int64_t length = file::size(source);
+                if(length > 0) {
+                    void *data = mmap(nullptr, (std::size_t)length, PROT_READ, MAP_PRIVATE, source, 0);
+                    if(data != MAP_FAILED) {
+                        if(_sequential)
+                            madvise(data, (std::size_t)length, MADV_SEQUENTIAL);
+                        mData = (const char*)data;
+                        mSize = (std::size_t)length;
+                    }
+                }
+                close_descriptor(source);
+                // mmap() refuses empty files, which are still valid input
+                mOpen = (mData != nullptr || length == 0);
+                return mOpen;
+            }
+            inline void close() {
+                if(mData)
+                    munmap((void*)mData, mSize);
+                mData = nullptr;
+                mSize = 0;
+                mOpen = false;
+            }
+            inline bool is_open() const { return mOpen; }
+            inline const char *data() const { return mData; }
+            inline std::size_t size() const { return mSize; }
+        private:
+            const char *mData;
+            std::size_t mSize;
+            bool mOpen;
+        };
+    #endif
     };
 };
 
@@ -1,13 +1,25 @@
 #pragma once
 
+#include <algorithm>
 #include <functional>
+#include <cstdint>
 #include <cstring>
 #include <stdio.h>
 #include <string>
 #include <memory>
 #include <list>
+#include <vector>
+#include <deque>
+#include <unordered_map>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <chrono>
+#include <limits>
 
 #include <stringutils.hpp>
+#include <fileutils.hpp>
 
 #if defined(_WIN32) || defined(_WIN64)
     #include <winsock2.h>
@@ -16,11 +28,34 @@
     #include <sys/types.h>
     #include <sys/socket.h>
     #include <netinet/in.h>
+    #include <netinet/tcp.h>
     #include <netdb.h>
     #include <unistd.h>
     #include <errno.h>
     #include <sys/ioctl.h>
     #include <sys/poll.h>
+    #include <sys/uio.h>
+#endif
+
+#if defined(__linux__)
+    #include <sys/epoll.h>
+    #include <sys/eventfd.h>
+    #include <netinet/udp.h>
+    #include <pthread.h>
+    #include <sched.h>
+    #include <signal.h>
+    #include <sys/sendfile.h>
+    #define UTIL_NET_HAS_EPOLL
+    #define UTIL_NET_HAS_MMSG
+    #define UTIL_NET_HAS_SENDFILE
+    #if __has_include(<linux/io_uring.h>)
+        #include <linux/io_uring.h>
+        #include <sys/mman.h>
+        #include <sys/syscall.h>
+        #if defined(__NR_io_uring_setup) && defined(__NR_io_uring_enter)
+            #define UTIL_NET_HAS_IO_URING
+        #endif
+    #endif
 #endif
 
 namespace util
@@ -61,36 +96,72 @@ namespace util
             typedef pollfd poll_descriptor;
         #endif
         
-        template<class storage_type = std::list<address_info>>
-        storage_type resolve(const std::string &_hostname)
+        // an address returned by name resolution; unlike a copied address_info
+        // it owns the socket address it describes
+        struct resolved_address
+        {
+            int family;
+            int type;
+            int protocol;
+            socklen_t length;
+            sockaddr_storage address;
+            
+            inline const sockaddr *data() const { return (const sockaddr*)&address; }
+            inline void set_port(int _port) {
+                if(family == AF_INET6)
+                    ((sockaddr_in6*)&address)->sin6_port = htons(_port);
+                else
+                    ((sockaddr_in*)&address)->sin_port = htons(_port);
+            }
+        };
+        
+        // getaddrinfo() into _result; returns its status (0 or an EAI_* code)
+        template<class storage_type>
+        int lookup_host(const std::string &_hostname, int _family, int _flags, storage_type &_result)
         {
-            storage_type result;
             address_info *hosts;
             
             address_info hints;
             memset(&hints, 0, sizeof(hints));
-            hints.ai_family = AF_UNSPEC;
+            hints.ai_family = _family;
             hints.ai_socktype = SOCK_STREAM;
             hints.ai_protocol = IPPROTO_TCP;
-
+            hints.ai_flags = _flags;
+            
             auto returnValue = getaddrinfo(_hostname.c_str(), nullptr, &hints, &hosts);
-
             if(returnValue != 0)
-                __throw_error_with_number("getaddrinfo() call failed whilst resolving '" + _hostname + "'");
-
+                return returnValue;
+            
             for(address_info *addr = hosts; addr != nullptr; addr = addr->ai_next)
             {
-                result.push_back(*addr);
+                resolved_address resolved;
+                memset(&resolved, 0, sizeof(resolved));
+                resolved.family = addr->ai_family;
+                resolved.type = addr->ai_socktype;
+                resolved.protocol = addr->ai_protocol;
+                resolved.length = (socklen_t)std::min<std::size_t>(addr->ai_addrlen, sizeof(resolved.address));
+                memcpy(&resolved.address, addr->ai_addr, resolved.length);
+                _result.push_back(resolved);
             }
             
             freeaddrinfo(hosts);
-
+            return 0;
+        }
+        
+        // blocks until the name is resolved; see resolver for the asynchronous variant
+        template<class storage_type = std::list<resolved_address>>
+        storage_type resolve(const std::string &_hostname, int _family = AF_UNSPEC)
+        {
+            storage_type result;
+            auto returnValue = lookup_host(_hostname, _family, 0, result);
+            if(returnValue != 0)
+                throw socket_exception("getaddrinfo() call failed whilst resolving '" + _hostname + "': " + gai_strerror(returnValue));
             return result;
         }
         
-        inline address_info resolve_to_any(const std::string &_hostname)
+        inline resolved_address resolve_to_any(const std::string &_hostname, int _family = AF_UNSPEC)
         {
-            auto result = resolve(_hostname);
+            auto result = resolve(_hostname, _family);
             if(result.empty())
                 throw socket_exception("unable to resolve hostname '" + _hostname + "'");
             return result.front();
@@ -124,14 +195,823 @@ namespace util
             #endif
         }
         
+        enum class service_backend
+        {
+            automatic,  // epoll where available, poll otherwise
+            poll,
+            epoll,
+            io_uring    // completion based; degrades to 'automatic' when unavailable
+        };
+        
+        inline int pending_error(socket _socket)
+        {
+            int error = 0;
+            socklen_t length = sizeof(error);
+            if(::getsockopt(_socket, SOL_SOCKET, SO_ERROR, (char*)&error, &length) < 0)
+                return errno;
+            return error;
+        }
+        
+        inline bool would_block(int _error)
+        {
+            return (_error == EAGAIN || _error == EWOULDBLOCK);
+        }
+        
+        // sockets of this library are non-blocking from creation on; the blocking
+        // calls are built from MSG_DONTWAIT attempts plus poll() when the socket
+        // is not ready, so the mode never has to be switched per call
+        inline socket create_socket(int _family, int _type, int _protocol)
+        {
+            #if defined(SOCK_NONBLOCK) && defined(SOCK_CLOEXEC)
+                return ::socket(_family, _type | SOCK_NONBLOCK | SOCK_CLOEXEC, _protocol);
+            #else
+                socket result = ::socket(_family, _type, _protocol);
+                if(result != invalid_socket)
+                    make_nonblocking(result);
+                #if defined(SO_NOSIGPIPE)
+                    // where MSG_NOSIGNAL may be missing, writes must not raise SIGPIPE
+                    int enabled = 1;
+                    if(result != invalid_socket)
+                        ::setsockopt(result, SOL_SOCKET, SO_NOSIGPIPE, &enabled, sizeof(enabled));
+                #endif
+                return result;
+            #endif
+        }
+        
+        inline socket accept_socket(socket _listener, sockaddr *_address, socklen_t *_length)
+        {
+            #if defined(__linux__)
+                return ::accept4(_listener, _address, _length, SOCK_NONBLOCK | SOCK_CLOEXEC);
+            #else
+                socket result = ::accept(_listener, _address, _length);
+                if(result != invalid_socket)
+                    make_nonblocking(result);
+                return result;
+            #endif
+        }
+        
+        inline bool wait_for(socket _socket, short _events, int _timeout = -1)
+        {
+            poll_descriptor descriptor;
+            descriptor.fd = _socket;
+            descriptor.events = _events;
+            descriptor.revents = 0;
+            for(;;)
+            {
+                #if defined(_WIN32) || defined(_WIN64)
+                    auto result = ::WSAPoll(&descriptor, 1, _timeout);
+                #else
+                    auto result = ::poll(&descriptor, 1, _timeout);
+                #endif
+                if(result > 0)
+                    return true;
+                if(result == 0)
+                {
+                    errno = ETIMEDOUT;
+                    return false;
+                }
+                if(errno != EINTR)
+                    return false;
+            }
+        }
+        
+        // repeats a non-blocking call until it stops reporting EAGAIN
+        template<typename Fun>
+        inline auto retry_blocking(socket _socket, short _events, Fun _fn) -> decltype(_fn())
+        {
+            for(;;)
+            {
+                auto result = _fn();
+                if(result >= 0 || !would_block(errno))
+                    return result;
+                if(!wait_for(_socket, _events))
+                    return -1;
+            }
+        }
+        
+        inline int connect_blocking(socket _socket, const sockaddr *_address, socklen_t _length)
+        {
+            if(::connect(_socket, _address, _length) == 0)
+                return 0;
+            if(errno != EINPROGRESS && !would_block(errno))
+                return -1;
+            if(!wait_for(_socket, POLLOUT))
+                return -1;
+            int error = pending_error(_socket);
+            if(error != 0)
+            {
+                errno = error;
+                return -1;
+            }
+            return 0;
+        }
+        
+        namespace internal
+        {
+            #if defined(UTIL_NET_HAS_SENDFILE)
+                // sendfile() cannot be told MSG_NOSIGNAL, so SIGPIPE is blocked for
+                // this thread while the guard lives; one raised by an EPIPE in
+                // between is consumed instead of killing the process
+                class sigpipe_guard
+                {
+                public:
+                    inline sigpipe_guard() {
+                        sigemptyset(&mPipe);
+                        sigaddset(&mPipe, SIGPIPE);
+                        sigset_t pending;
+                        sigpending(&pending);
+                        mWasPending = sigismember(&pending, SIGPIPE) == 1;
+                        pthread_sigmask(SIG_BLOCK, &mPipe, &mPrevious);
+                    }
+                    inline ~sigpipe_guard() {
+                        if(!mWasPending)
+                        {
+                            int error = errno;
+                            timespec immediately = {0, 0};
+                            while(sigtimedwait(&mPipe, nullptr, &immediately) < 0 && errno == EINTR);
+                            errno = error;
+                        }
+                        pthread_sigmask(SIG_SETMASK, &mPrevious, nullptr);
+                    }
+                    sigpipe_guard(const sigpipe_guard&) = delete;
+                    sigpipe_guard &operator=(const sigpipe_guard&) = delete;
+                private:
+                    sigset_t mPipe;
+                    sigset_t mPrevious;
+                    bool mWasPending;
+                };
+            #endif
+            
+            // lets other threads interrupt a service blocked in its poll
+            class wakeup_descriptor
+            {
+            public:
+                inline wakeup_descriptor() {
+                    #if defined(__linux__)
+                        mRead = mWrite = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+                        if(mRead == invalid_socket)
+                            __throw_error_with_number("failed to create wakeup descriptor");
+                    #else
+                        int pipes[2];
+                        if(::pipe(pipes) < 0)
+                            __throw_error_with_number("failed to create wakeup descriptor");
+                        mRead = pipes[0];
+                        mWrite = pipes[1];
+                        int argument = 1;
+                        ioctl(mRead, FIONBIO, &argument);
+                        ioctl(mWrite, FIONBIO, &argument);
+                    #endif
+                }
+                wakeup_descriptor(const wakeup_descriptor&) = delete;
+                wakeup_descriptor &operator=(const wakeup_descriptor&) = delete;
+                inline ~wakeup_descriptor() {
+                    ::close(mRead);
+                    if(mWrite != mRead)
+                        ::close(mWrite);
+                }
+                inline socket handle() const { return mRead; }
+                inline void signal() {
+                    uint64_t value = 1;
+                    auto written = ::write(mWrite, &value, sizeof(value));
+                    (void)written;
+                }
+                inline void drain() {
+                    uint64_t values[8];
+                    while(::read(mRead, values, sizeof(values)) > 0)
+                        ;
+                }
+            private:
+                socket mRead;
+                socket mWrite;
+            };
+            
+            // milliseconds on a clock that never jumps
+            inline std::uint64_t monotonic_clock() {
+                return (std::uint64_t)std::chrono::duration_cast<std::chrono::milliseconds>(
+                    std::chrono::steady_clock::now().time_since_epoch()).count();
+            }
+            
+            // hierarchical timing wheel with millisecond ticks: four levels of 64
+            // slots cover ~4.6 hours, later deadlines are parked on the top level
+            // and re-placed when it comes around. Inserting and cancelling are O(1),
+            // an empty slot costs nothing since only the occupied ones are visited
+            class timer_wheel
+            {
+            public:
+                typedef std::uint64_t timer_id;
+            public:
+                inline timer_wheel(std::uint64_t _now)
+                    : mNow(_now), mCount(0) {
+                    for(auto &head : mHeads)
+                        head = npos;
+                    for(auto &occupied : mOccupied)
+                        occupied = 0;
+                }
+                inline std::size_t size() const { return mCount; }
+                inline bool empty() const { return mCount == 0; }
+                inline std::uint64_t now() const { return mNow; }
+                // deadlines that are not in the future fire on the next tick
+                inline timer_id add(std::uint64_t _deadline, std::function<void()> _callback) {
+                    std::size_t index;
+                    if(!mFree.empty())
+                    {
+                        index = mFree.back();
+                        mFree.pop_back();
+                    }
+                    else
+                    {
+                        index = mTimers.size();
+                        mTimers.emplace_back();
+                    }
+                    timer &entry = mTimers[index];
+                    entry.callback = std::move(_callback);
+                    entry.deadline = std::max(_deadline, mNow + 1);
+                    entry.active = true;
+                    place(index);
+                    mCount ++;
+                    return ((timer_id)entry.generation << 32) | index;
+                }
+                inline bool cancel(timer_id _id) {
+                    std::size_t index = (std::size_t)(_id & 0xffffffff);
+                    if(index >= mTimers.size())
+                        return false;
+                    timer &entry = mTimers[index];
+                    if(!entry.active || entry.generation != (std::uint32_t)(_id >> 32))
+                        return false;
+                    unlink(index);
+                    release(index);
+                    return true;
+                }
+                // the tick at which the wheel next has work to do: a timer expiring
+                // or a higher level slot cascading down; max() when nothing is armed
+                inline std::uint64_t next_expiry() const {
+                    std::uint64_t result = std::numeric_limits<std::uint64_t>::max();
+                    for(unsigned int level = 0; level < levels; level++)
+                    {
+                        if(mOccupied[level] == 0)
+                            continue;
+                        unsigned int shift = level * bits;
+                        unsigned int current = (unsigned int)(mNow >> shift) & (slots - 1);
+                        // rotate so that the slot after 'current' becomes bit 0
+                        std::uint64_t rotated = rotate(mOccupied[level], (current + 1) & (slots - 1));
+                        std::uint64_t distance = (std::uint64_t)__builtin_ctzll(rotated) + 1;
+                        std::uint64_t tick = ((mNow >> shift) + distance) << shift;
+                        result = std::min(result, tick);
+                    }
+                    return result;
+                }
+                // moves the wheel to _now and runs every timer that expired on the
+                // way; callbacks may add and cancel timers. Returns the number run
+                inline std::size_t advance(std::uint64_t _now) {
+                    std::size_t expired = 0;
+                    while(mCount > 0)
+                    {
+                        std::uint64_t tick = next_expiry();
+                        if(tick > _now)
+                            break;
+                        mNow = tick;
+                        for(unsigned int level = levels - 1; level > 0; level--)
+                        {
+                            if((mNow & (((std::uint64_t)1 << (level * bits)) - 1)) == 0)
+                                cascade(level);
+                        }
+                        expired += expire();
+                    }
+                    if(_now > mNow)
+                        mNow = _now;
+                    return expired;
+                }
+            private:
+                static const unsigned int bits = 6;
+                static const unsigned int slots = 1 << bits;
+                static const unsigned int levels = 4;
+                static const std::size_t npos = (std::size_t)(-1);
+                
+                struct timer
+                {
+                    inline timer()
+                        : deadline(0), generation(1), previous(npos), next(npos), bucket(0), active(false) {}
+                    std::function<void()> callback;
+                    std::uint64_t deadline;
+                    std::uint32_t generation;
+                    std::size_t previous;
+                    std::size_t next;
+                    unsigned int bucket;
+                    bool active;
+                };
+                
+                static inline std::uint64_t rotate(std::uint64_t _value, unsigned int _count) {
+                    return _count == 0 ? _value : (_value >> _count) | (_value << (slots - _count));
+                }
+                // a timer sits on the lowest level whose slots still tell its
+                // deadline apart from the current tick
+                inline void place(std::size_t _index) {
+                    timer &entry = mTimers[_index];
+                    unsigned int level = 0;
+                    while(level + 1 < levels && (entry.deadline >> ((level + 1) * bits)) != (mNow >> ((level + 1) * bits)))
+                        level ++;
+                    unsigned int shift = level * bits;
+                    unsigned int slot = (unsigned int)(std::max(entry.deadline, mNow) >> shift) & (slots - 1);
+                    // the top level may wrap; anything beyond a full turn is parked
+                    // on the current slot and revisited once the turn is complete
+                    if(level == levels - 1 && (entry.deadline >> shift) - (mNow >> shift) > slots)
+                        slot = (unsigned int)(mNow >> shift) & (slots - 1);
+                    entry.bucket = level * slots + slot;
+                    entry.previous = npos;
+                    entry.next = mHeads[entry.bucket];
+                    if(entry.next != npos)
+                        mTimers[entry.next].previous = _index;
+                    mHeads[entry.bucket] = _index;
+                    mOccupied[level] |= (std::uint64_t)1 << slot;
+                }
+                inline void unlink(std::size_t _index) {
+                    timer &entry = mTimers[_index];
+                    if(entry.previous != npos)
+                        mTimers[entry.previous].next = entry.next;
+                    else
+                    {
+                        mHeads[entry.bucket] = entry.next;
+                        if(entry.next == npos)
+                            mOccupied[entry.bucket / slots] &= ~((std::uint64_t)1 << (entry.bucket % slots));
+                    }
+                    if(entry.next != npos)
+                        mTimers[entry.next].previous = entry.previous;
+                    entry.previous = entry.next = npos;
+                }
+                inline void release(std::size_t _index) {
+                    timer &entry = mTimers[_index];
+                    entry.callback = nullptr;
+                    entry.active = false;
+                    entry.generation = (entry.generation + 1) & 0x7fffffff;
+                    if(entry.generation == 0)
+                        entry.generation = 1;
+                    mFree.push_back(_index);
+                    mCount --;
+                }
+                // spreads the slot of _level that the current tick just reached
+                // over the levels below
+                inline void cascade(unsigned int _level) {
+                    unsigned int slot = (unsigned int)(mNow >> (_level * bits)) & (slots - 1);
+                    unsigned int bucket = _level * slots + slot;
+                    std::size_t index = mHeads[bucket];
+                    mHeads[bucket] = npos;
+                    mOccupied[_level] &= ~((std::uint64_t)1 << slot);
+                    while(index != npos)
+                    {
+                        std::size_t next = mTimers[index].next;
+                        place(index);
+                        index = next;
+                    }
+                }
+                inline std::size_t expire() {
+                    std::size_t expired = 0;
+                    unsigned int bucket = (unsigned int)mNow & (slots - 1);
+                    while(mHeads[bucket] != npos)
+                    {
+                        std::size_t index = mHeads[bucket];
+                        unlink(index);
+                        std::function<void()> callback;
+                        callback.swap(mTimers[index].callback);
+                        release(index);
+                        callback();
+                        expired ++;
+                    }
+                    return expired;
+                }
+            private:
+                std::deque<timer> mTimers;
+                std::vector<std::size_t> mFree;
+                std::size_t mHeads[levels * slots];
+                std::uint64_t mOccupied[levels];
+                std::uint64_t mNow;
+                std::size_t mCount;
+            };
+        };
+        
+        #if defined(UTIL_NET_HAS_IO_URING)
+        namespace internal
+        {
+            // minimal io_uring submission/completion queue driven through the raw
+            // system calls, so no liburing is required
+            class uring_queue
+            {
+            public:
+                inline uring_queue()
+                    : mRing(-1), mSubmissionRing(nullptr), mSubmissionRingSize(0),
+                      mCompletionRing(nullptr), mCompletionRingSize(0),
+                      mEntries(nullptr), mEntryCount(0), mLocalTail(0) {}
+                uring_queue(const uring_queue&) = delete;
+                uring_queue &operator=(const uring_queue&) = delete;
+                inline ~uring_queue() {
+                    close();
+                }
+                inline bool open(unsigned int _entries) {
+                    io_uring_params params;
+                    memset(&params, 0, sizeof(params));
+                    mRing = (int)::syscall(__NR_io_uring_setup, _entries, &params);
+                    if(mRing < 0)
+                        return false;
+                    // waits carry their timeout directly (Linux 5.11+)
+                    if(!(params.features & IORING_FEAT_EXT_ARG))
+                    {
+                        close();
+                        return false;
+                    }
+                    
+                    mSubmissionRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned int);
+                    mCompletionRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+                    bool single = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+                    if(single && mCompletionRingSize > mSubmissionRingSize)
+                        mSubmissionRingSize = mCompletionRingSize;
+                    
+                    mSubmissionRing = ::mmap(nullptr, mSubmissionRingSize, PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_POPULATE, mRing, IORING_OFF_SQ_RING);
+                    if(mSubmissionRing == MAP_FAILED)
+                    {
+                        mSubmissionRing = nullptr;
+                        close();
+                        return false;
+                    }
+                    if(single)
+                        mCompletionRing = mSubmissionRing;
+                    else
+                    {
+                        mCompletionRing = ::mmap(nullptr, mCompletionRingSize, PROT_READ | PROT_WRITE,
+                            MAP_SHARED | MAP_POPULATE, mRing, IORING_OFF_CQ_RING);
+                        if(mCompletionRing == MAP_FAILED)
+                        {
+                            mCompletionRing = nullptr;
+                            close();
+                            return false;
+                        }
+                    }
+                    mEntryCount = params.sq_entries;
+                    void *entries = ::mmap(nullptr, mEntryCount * sizeof(io_uring_sqe), PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_POPULATE, mRing, IORING_OFF_SQES);
+                    if(entries == MAP_FAILED)
+                    {
+                        close();
+                        return false;
+                    }
+                    mEntries = (io_uring_sqe*)entries;
+                    
+                    char *sq = (char*)mSubmissionRing;
+                    mSqHead = (unsigned int*)(sq + params.sq_off.head);
+                    mSqTail = (unsigned int*)(sq + params.sq_off.tail);
+                    mSqMask = *(unsigned int*)(sq + params.sq_off.ring_mask);
+                    mSqArray = (unsigned int*)(sq + params.sq_off.array);
+                    char *cq = (char*)mCompletionRing;
+                    mCqHead = (unsigned int*)(cq + params.cq_off.head);
+                    mCqTail = (unsigned int*)(cq + params.cq_off.tail);
+                    mCqMask = *(unsigned int*)(cq + params.cq_off.ring_mask);
+                    mCqes = (io_uring_cqe*)(cq + params.cq_off.cqes);
+                    mLocalTail = *mSqTail;
+                    return true;
+                }
+                inline void close() {
+                    if(mEntries != nullptr)
+                        ::munmap(mEntries, mEntryCount * sizeof(io_uring_sqe));
+                    if(mCompletionRing != nullptr && mCompletionRing != mSubmissionRing)
+                        ::munmap(mCompletionRing, mCompletionRingSize);
+                    if(mSubmissionRing != nullptr)
+                        ::munmap(mSubmissionRing, mSubmissionRingSize);
+                    if(mRing >= 0)
+                        ::close(mRing);
+                    mEntries = nullptr;
+                    mCompletionRing = mSubmissionRing = nullptr;
+                    mRing = -1;
+                }
+                inline bool is_open() const { return mRing >= 0; }
+                // returns a zeroed entry, flushing the queue to the kernel when full
+                inline io_uring_sqe *next() {
+                    if(mLocalTail - __atomic_load_n(mSqHead, __ATOMIC_ACQUIRE) >= mEntryCount)
+                    {
+                        if(enter(0) < 0 && errno != EBUSY && errno != EINTR)
+                            return nullptr;
+                        if(mLocalTail - __atomic_load_n(mSqHead, __ATOMIC_ACQUIRE) >= mEntryCount)
+                            return nullptr;
+                    }
+                    unsigned int index = mLocalTail & mSqMask;
+                    io_uring_sqe *entry = &mEntries[index];
+                    memset(entry, 0, sizeof(io_uring_sqe));
+                    mSqArray[index] = index;
+                    mLocalTail ++;
+                    return entry;
+                }
+                // submits everything queued so far and optionally waits up to _timeout
+                // milliseconds (-1: forever) for completions, all within a single system call
+                inline int enter(unsigned int _wait_for, int _timeout = -1) {
+                    __atomic_store_n(mSqTail, mLocalTail, __ATOMIC_RELEASE);
+                    unsigned int pending = mLocalTail - __atomic_load_n(mSqHead, __ATOMIC_ACQUIRE);
+                    if(pending == 0 && _wait_for == 0)
+                        return 0;
+                    if(_wait_for == 0)
+                        return (int)::syscall(__NR_io_uring_enter, mRing, pending, 0, 0, nullptr, 0);
+                    
+                    __kernel_timespec timeout;
+                    timeout.tv_sec = _timeout / 1000;
+                    timeout.tv_nsec = (_timeout % 1000) * 1000000LL;
+                    io_uring_getevents_arg argument;
+                    memset(&argument, 0, sizeof(argument));
+                    argument.ts = _timeout >= 0 ? (__u64)&timeout : 0;
+                    return (int)::syscall(__NR_io_uring_enter, mRing, pending, _wait_for,
+                        IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &argument, sizeof(argument));
+                }
+                template<typename Fun>
+                inline unsigned int reap(Fun _fn) {
+                    unsigned int count = 0;
+                    unsigned int head = *mCqHead;
+                    while(head != __atomic_load_n(mCqTail, __ATOMIC_ACQUIRE))
+                    {
+                        const io_uring_cqe &entry = mCqes[head & mCqMask];
+                        __u64 user_data = entry.user_data;
+                        int result = entry.res;
+                        head ++;
+                        __atomic_store_n(mCqHead, head, __ATOMIC_RELEASE);
+                        _fn(user_data, result);
+                        count ++;
+                    }
+                    return count;
+                }
+            private:
+                int mRing;
+                void *mSubmissionRing;
+                std::size_t mSubmissionRingSize;
+                void *mCompletionRing;
+                std::size_t mCompletionRingSize;
+                io_uring_sqe *mEntries;
+                unsigned int mEntryCount;
+                unsigned int mLocalTail;
+                unsigned int *mSqHead;
+                unsigned int *mSqTail;
+                unsigned int mSqMask;
+                unsigned int *mSqArray;
+                unsigned int *mCqHead;
+                unsigned int *mCqTail;
+                unsigned int mCqMask;
+                io_uring_cqe *mCqes;
+            };
+        };
+        #endif
+        
+        // identifies a registered handler; stays unique after the handler is gone
+        typedef std::uint64_t handler_id;
+        const handler_id invalid_handler = 0;
+        
+        // identifies an armed timer of a service
+        typedef internal::timer_wheel::timer_id timer_id;
+        const timer_id invalid_timer = 0;
+        
+        // statistics are only collected when UTIL_NET_ENABLE_STATS is defined;
+        // otherwise the stats() accessors and every bookkeeping statement vanish
+        #if defined(UTIL_NET_ENABLE_STATS)
+            #define UTIL_NET_STAT(statement) statement
+        #else
+            #define UTIL_NET_STAT(statement)
+        #endif
+        
+        namespace stats
+        {
+            // written by the thread owning the service only, so the atomics just
+            // make it safe to read them from elsewhere; no locked instructions
+            class counter
+            {
+            public:
+                inline counter() : mValue(0) {}
+                inline void add(std::uint64_t _count = 1) {
+                    mValue.store(mValue.load(std::memory_order_relaxed) + _count, std::memory_order_relaxed);
+                }
+                inline std::uint64_t value() const { return mValue.load(std::memory_order_relaxed); }
+            private:
+                std::atomic<std::uint64_t> mValue;
+            };
+            
+            struct histogram_snapshot
+            {
+                std::vector<std::uint64_t> buckets;
+                std::uint64_t count;
+                std::uint64_t sum;
+                
+                // smallest recorded value bound such that _percentile percent of
+                // the samples are not above it (within the 1/16 bucket precision)
+                inline std::uint64_t value_at(double _percentile) const;
+                inline double mean() const { return count > 0 ? (double)sum / count : 0.0; }
+            };
+            
+            // log-linear buckets in the style of HDR histograms: every power of two
+            // is split into 16 sub-buckets, so any value is recorded with a
+            // relative error below 6.25% in constant time and memory
+            class histogram
+            {
+            public:
+                static const unsigned int sub_bits = 4;
+                static const unsigned int sub_buckets = 1 << sub_bits;
+                static const unsigned int bucket_count = (64 - sub_bits + 1) * sub_buckets;
+            public:
+                inline histogram() : mSum(0) {
+                    for(auto &bucket : mBuckets)
+                        bucket.store(0, std::memory_order_relaxed);
+                }
+                inline void record(std::uint64_t _value) {
+                    std::atomic<std::uint64_t> &bucket = mBuckets[index(_value)];
+                    bucket.store(bucket.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+                    mSum.store(mSum.load(std::memory_order_relaxed) + _value, std::memory_order_relaxed);
+                }
+                // taken while recording may go on, so count and sum can be a
+                // sample or so apart
+                inline histogram_snapshot snapshot() const {
+                    histogram_snapshot result;
+                    result.buckets.resize(bucket_count);
+                    result.count = 0;
+                    for(unsigned int i = 0; i < bucket_count; i++)
+                    {
+                        result.buckets[i] = mBuckets[i].load(std::memory_order_relaxed);
+                        result.count += result.buckets[i];
+                    }
+                    result.sum = mSum.load(std::memory_order_relaxed);
+                    return result;
+                }
+                static inline unsigned int index(std::uint64_t _value) {
+                    if(_value < sub_buckets)
+                        return (unsigned int)_value;
+                    unsigned int exponent = 63 - __builtin_clzll(_value);
+                    unsigned int sub = (unsigned int)(_value >> (exponent - sub_bits)) & (sub_buckets - 1);
+                    return (exponent - sub_bits + 1) * sub_buckets + sub;
+                }
+                // the largest value recorded into bucket _index
+                static inline std::uint64_t upper_bound(unsigned int _index) {
+                    if(_index < sub_buckets)
+                        return _index;
+                    unsigned int exponent = _index / sub_buckets + sub_bits - 1;
+                    std::uint64_t base = (std::uint64_t)(_index % sub_buckets + sub_buckets) << (exponent - sub_bits);
+                    return base + (((std::uint64_t)1 << (exponent - sub_bits)) - 1);
+                }
+            private:
+                std::atomic<std::uint64_t> mBuckets[bucket_count];
+                std::atomic<std::uint64_t> mSum;
+            };
+            
+            inline std::uint64_t histogram_snapshot::value_at(double _percentile) const {
+                if(count == 0)
+                    return 0;
+                std::uint64_t rank = (std::uint64_t)(_percentile / 100.0 * count + 0.5);
+                rank = std::max<std::uint64_t>(rank, 1);
+                std::uint64_t seen = 0;
+                for(unsigned int i = 0; i < buckets.size(); i++)
+                {
+                    seen += buckets[i];
+                    if(seen >= rank)
+                        return histogram::upper_bound(i);
+                }
+                return histogram::upper_bound(buckets.size() - 1);
+            }
+            
+            // durations are in nanoseconds
+            struct service_snapshot
+            {
+                std::uint64_t polls;
+                std::uint64_t events;
+                std::uint64_t handlers;
+                std::uint64_t completions;
+                std::uint64_t timers;
+                std::uint64_t posted;
+                histogram_snapshot poll_wait;
+                histogram_snapshot callback_time;
+                histogram_snapshot events_per_poll;
+            };
+            
+            struct service_stats
+            {
+                counter polls;
+                counter events;
+                counter handlers;       // readiness callbacks run
+                counter completions;    // io_uring completions delivered
+                counter timers;
+                counter posted;
+                histogram poll_wait;
+                histogram callback_time;
+                histogram events_per_poll;
+                
+                // best-effort view: every counter is read atomically, but the
+                // service keeps running, so counters and histograms may not
+                // agree exactly with each other
+                inline service_snapshot snapshot() const {
+                    service_snapshot result;
+                    result.polls = polls.value();
+                    result.events = events.value();
+                    result.handlers = handlers.value();
+                    result.completions = completions.value();
+                    result.timers = timers.value();
+                    result.posted = posted.value();
+                    result.poll_wait = poll_wait.snapshot();
+                    result.callback_time = callback_time.snapshot();
+                    result.events_per_poll = events_per_poll.snapshot();
+                    return result;
+                }
+            };
+            
+            struct socket_snapshot
+            {
+                std::uint64_t bytes_in;
+                std::uint64_t bytes_out;
+                std::uint64_t reads;
+                std::uint64_t writes;
+                std::uint64_t blocked;
+                std::uint64_t errors;
+                std::uint64_t accepted;
+            };
+            
+            struct socket_stats
+            {
+                counter bytes_in;
+                counter bytes_out;
+                counter reads;
+                counter writes;
+                counter blocked;        // calls that failed with EAGAIN
+                counter errors;
+                counter accepted;
+                
+                // classify the result of a recv/send style call; errno is only
+                // looked at for negative results
+                inline void record_read(long long _result) {
+                    if(_result >= 0)
+                    {
+                        reads.add();
+                        bytes_in.add(_result);
+                    }
+                    else
+                        failed();
+                }
+                inline void record_write(long long _result) {
+                    if(_result >= 0)
+                    {
+                        writes.add();
+                        bytes_out.add(_result);
+                    }
+                    else
+                        failed();
+                }
+                inline void failed() {
+                    if(util::net::would_block(errno))
+                        blocked.add();
+                    else
+                        errors.add();
+                }
+                // best-effort like service_stats::snapshot(); e.g. reads may
+                // already count a call whose bytes are not in bytes_in yet
+                inline socket_snapshot snapshot() const {
+                    socket_snapshot result;
+                    result.bytes_in = bytes_in.value();
+                    result.bytes_out = bytes_out.value();
+                    result.reads = reads.value();
+                    result.writes = writes.value();
+                    result.blocked = blocked.value();
+                    result.errors = errors.value();
+                    result.accepted = accepted.value();
+                    return result;
+                }
+            };
+            
+            // nanoseconds for the duration histograms
+            inline std::uint64_t now() {
+                return (std::uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::steady_clock::now().time_since_epoch()).count();
+            }
+        };
+        
         class service;
         
+        // lets other threads post to a service that may be destroyed meanwhile;
+        // the service detaches it on destruction, later posts are dropped
+        class service_link
+        {
+        public:
+            inline explicit service_link(service *_target) : mTarget(_target) {}
+            // false (and _task dropped) once the service is gone
+            inline bool post(std::function<void()> _task);
+            inline void detach() {
+                std::lock_guard<std::mutex> lock(mLock);
+                mTarget = nullptr;
+            }
+        private:
+            std::mutex mLock;
+            service *mTarget;
+        };
+        
         class base_socket
         {
         public:
             inline base_socket(service &_service) : mService(_service) {}
+            // stops a stream started by read_stream()
+            inline bool cancel(handler_id _id);
+            #if defined(UTIL_NET_ENABLE_STATS)
+                inline const stats::socket_stats &statistics() const { return mStats; }
+            #endif
         protected:
             service &mService;
+            #if defined(UTIL_NET_ENABLE_STATS)
+                stats::socket_stats mStats;
+            #endif
         };
         
         class socket_event_handler
@@ -147,11 +1027,12 @@ namespace util
                 : mRead(_read), mSocket(_socket), mWrite(_write), mError(_error) {}
             inline socket_event_handler(const socket_event_handler &_copy)
                 : mRead(_copy.mRead), mSocket(_copy.mSocket), mWrite(_copy.mWrite), mError(_copy.mError) {}
+            inline socket_event_handler &operator=(const socket_event_handler &_copy) = default;
             inline bool wants_to_read() const { return !!mRead; }
             inline bool wants_to_write() const { return !!mWrite; }
             inline void on_read() { mRead(); }
             inline void on_write() { mWrite(); }
-            inline void on_error() { mError(); }
+            inline void on_error() { if(mError) mError(); }
             inline socket handle() const { return mSocket; }
         private:
             read_fn mRead;
@@ -163,197 +1044,2082 @@ namespace util
         class service
         {
         public:
-            inline void add_handler(const socket_event_handler &_handler) {
-                mHandlers.push_back(_handler);
-            }
-            inline bool do_poll(int _timeout = 100) {
-                if(mHandlers.size() < 1) return false;
+            // completion callbacks receive the operation result: the byte count,
+            // the accepted socket or zero on success, -errno on failure
+            typedef std::function<void(int)> completion_fn;
+        public:
+            inline service(service_backend _backend = service_backend::automatic)
+                : mBackend(_backend), mDepth(0), mHandlerCount(0), mOperationCount(0), mPoller(invalid_socket),
+                  mCurrent(invalid_handler), mTimers(internal::monotonic_clock()), mStopped(false),
+                  mLink(std::make_shared<service_link>(this)) {
+                bool uring = false;
+                #if defined(UTIL_NET_HAS_IO_URING)
+                    if(mBackend == service_backend::io_uring)
+                        uring = mQueue.open(256);
+                #endif
+                if(mBackend == service_backend::io_uring)
+                    mBackend = service_backend::automatic;
                 
-                std::vector<socket_event_handler> handlers;
-                handlers.insert(handlers.begin(), std::begin(mHandlers), std::end(mHandlers));
-                mHandlers.clear();
+                #if defined(UTIL_NET_HAS_EPOLL)
+                    if(mBackend != service_backend::poll) {
+                        mPoller = ::epoll_create1(EPOLL_CLOEXEC);
+                        if(mPoller == invalid_socket) {
+                            if(mBackend == service_backend::epoll)
+                                __throw_error_with_number("failed to create epoll instance");
+                            mBackend = service_backend::poll;
+                        } else {
+                            mBackend = service_backend::epoll;
+                            mEvents.resize(64);
+                            
+                            epoll_event event;
+                            event.events = EPOLLIN;
+                            event.data.u64 = 0;
+                            event.data.fd = mWakeup.handle();
+                            if(::epoll_ctl(mPoller, EPOLL_CTL_ADD, mWakeup.handle(), &event) < 0)
+                                __throw_error_with_number("failed to register wakeup descriptor");
+                        }
+                    }
+                #else
+                    if(mBackend == service_backend::epoll)
+                        throw socket_exception("epoll backend is not available on this platform");
+                    mBackend = service_backend::poll;
+                #endif
                 
-                std::unique_ptr<poll_descriptor> descriptors(new poll_descriptor[handlers.size()]);
-                std::unique_ptr<bool> preserve_flags(new bool[handlers.size()]);
+                #if defined(UTIL_NET_HAS_IO_URING)
+                    // readiness handlers keep going through epoll, whose descriptor
+                    // is itself watched by the ring
+                    if(uring && mBackend == service_backend::epoll)
+                    {
+                        mBackend = service_backend::io_uring;
+                        mPollerArmed = false;
+                    }
+                    else
+                        mQueue.close();
+                #endif
+            }
+            service(const service&) = delete;
+            service &operator=(const service&) = delete;
+            inline ~service() {
+                mLink->detach();
+                #if defined(UTIL_NET_HAS_EPOLL)
+                    if(mPoller != invalid_socket)
+                        ::close(mPoller);
+                #endif
+            }
+            inline service_backend backend() const { return mBackend; }
+            #if defined(UTIL_NET_ENABLE_STATS)
+                // may be read from any thread while the service runs
+                inline const stats::service_stats &statistics() const { return mStats; }
+            #endif
+            // a handler fires once and is dropped, unless it is _persistent: then it
+            // stays armed until cancel_handler(), remove_handlers() or a socket error
+            inline handler_id add_handler(const socket_event_handler &_handler, bool _persistent = false) {
+                std::size_t index;
+                if(!mFreeSlots.empty())
+                {
+                    index = mFreeSlots.back();
+                    mFreeSlots.pop_back();
+                }
+                else
+                {
+                    index = mSlots.size();
+                    mSlots.emplace_back();
+                }
+                handler_slot &slot = mSlots[index];
+                slot.handler = _handler;
+                slot.active = true;
+                slot.persistent = _persistent;
+                slot.reading = _handler.wants_to_read();
+                slot.writing = _handler.wants_to_write();
                 
-                for(unsigned int i = 0; i < handlers.size(); i++)
+                auto &entry = mDescriptors[_handler.handle()];
+                link(entry, index);
+                mark_changed(_handler.handle(), entry);
+                return ((handler_id)slot.generation << 32) | index;
+            }
+            // also cancels operations started by the async_* members; the buffer of
+            // a cancelled io_uring operation may still be written until the kernel
+            // has processed the cancellation
+            inline bool cancel_handler(handler_id _id) {
+                if(_id & operation_flag)
                 {
-                    poll_descriptor &descriptor = descriptors.get()[i];
-                    descriptor.fd = handlers[i].handle();
-                    descriptor.events = 0;
-                    if(handlers[i].wants_to_read())
-                        descriptor.events |= POLLIN;
-                    if(handlers[i].wants_to_write())
-                        descriptor.events |= POLLOUT;
-                    preserve_flags.get()[i] = true;
+                    #if defined(UTIL_NET_HAS_IO_URING)
+                        std::size_t index = (std::size_t)(_id & 0xffffffff);
+                        if(index >= mOperations.size() || operation_id(index) != _id)
+                            return false;
+                        if(mOperations[index].cancelled || !mOperations[index].callback)
+                            return false;
+                        cancel_operation(index);
+                        return true;
+                    #else
+                        return false;
+                    #endif
+                }
+                handler_slot *slot = find_slot(_id);
+                if(slot == nullptr)
+                    return false;
+                if(slot->linked)
+                {
+                    auto &entry = mDescriptors[slot->handler.handle()];
+                    unlink(entry, (std::size_t)(_id & 0xffffffff));
+                    mark_changed(slot->handler.handle(), entry);
+                }
+                release((std::size_t)(_id & 0xffffffff));
+                return true;
+            }
+            // switches the events a registered handler listens for without
+            // re-creating it; only callbacks the handler was created with can fire
+            inline bool modify_handler(handler_id _id, bool _read, bool _write) {
+                handler_slot *slot = find_slot(_id);
+                if(slot == nullptr || !slot->linked)
+                    return false;
+                slot->reading = _read && slot->handler.wants_to_read();
+                slot->writing = _write && slot->handler.wants_to_write();
+                mark_changed(slot->handler.handle(), mDescriptors[slot->handler.handle()]);
+                return true;
+            }
+            // whether any handler or operation is still pending for _socket
+            inline bool has_handlers(socket _socket) const {
+                auto found = mDescriptors.find(_socket);
+                if(found == mDescriptors.end())
+                    return false;
+                return (found->second.handlers > 0 || !found->second.operations.empty());
+            }
+            // drops every pending handler of _socket without invoking it; must be
+            // called before the descriptor is closed so the kernel registration
+            // can be released and a reused descriptor number starts clean
+            inline void remove_handlers(socket _socket) {
+                auto found = mDescriptors.find(_socket);
+                if(found == mDescriptors.end())
+                    return;
+                for(std::size_t i = found->second.first; i != npos;)
+                {
+                    std::size_t next = mSlots[i].next;
+                    unlink(found->second, i);
+                    release(i);
+                    i = next;
+                }
+                #if defined(UTIL_NET_HAS_EPOLL)
+                    if(found->second.registered)
+                        ::epoll_ctl(mPoller, EPOLL_CTL_DEL, _socket, nullptr);
+                #endif
+                #if defined(UTIL_NET_HAS_IO_URING)
+                    // in-flight operations still complete, but their callbacks are dropped
+                    while(!found->second.operations.empty())
+                        cancel_operation(found->second.operations.back());
+                #endif
+                mDescriptors.erase(found);
+            }
+            // the async_* members return an id that cancel_handler() accepts; the
+            // retry after a spurious wake-up keeps the same handler
+            inline handler_id async_recv(socket _socket, char *_data, int _size, completion_fn _callback) {
+                #if defined(UTIL_NET_HAS_IO_URING)
+                    if(mBackend == service_backend::io_uring)
+                    {
+                        io_uring_sqe *entry = prepare(_socket, IORING_OP_RECV, _callback);
+                        entry->addr = (__u64)_data;
+                        entry->len = _size;
+                        return operation_id(entry->user_data);
+                    }
+                #endif
+                return add_handler(socket_event_handler(_socket,
+                    [=](){
+                        auto result = ::recv(_socket, _data, _size, MSG_DONTWAIT);
+                        if(result < 0 && would_block(errno))
+                            return;
+                        cancel_handler(current_handler());
+                        _callback(result < 0 ? -errno : (int)result);
+                    }, nullptr,
+                    [=](){
+                        _callback(-pending_error(_socket));
+                    }
+                ), true);
+            }
+            inline handler_id async_send(socket _socket, const char *_data, int _count, completion_fn _callback) {
+                #if defined(UTIL_NET_HAS_IO_URING)
+                    if(mBackend == service_backend::io_uring)
+                    {
+                        io_uring_sqe *entry = prepare(_socket, IORING_OP_SEND, _callback);
+                        entry->addr = (__u64)_data;
+                        entry->len = _count;
+                        return operation_id(entry->user_data);
+                    }
+                #endif
+                return add_handler(socket_event_handler(_socket, nullptr,
+                    [=](){
+                        auto result = ::send(_socket, _data, _count, MSG_DONTWAIT);
+                        if(result < 0 && would_block(errno))
+                            return;
+                        cancel_handler(current_handler());
+                        _callback(result < 0 ? -errno : (int)result);
+                    },
+                    [=](){
+                        _callback(-pending_error(_socket));
+                    }
+                ), true);
+            }
+            inline handler_id async_accept(socket _socket, completion_fn _callback) {
+                #if defined(UTIL_NET_HAS_IO_URING)
+                    if(mBackend == service_backend::io_uring)
+                    {
+                        io_uring_sqe *entry = prepare(_socket, IORING_OP_ACCEPT, _callback);
+                        entry->accept_flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
+                        return operation_id(entry->user_data);
+                    }
+                #endif
+                return add_handler(socket_event_handler(_socket,
+                    [=](){
+                        socket accepted = accept_socket(_socket, nullptr, nullptr);
+                        if(accepted == invalid_socket && would_block(errno))
+                            return;
+                        cancel_handler(current_handler());
+                        _callback(accepted == invalid_socket ? -errno : accepted);
+                    }, nullptr,
+                    [=](){
+                        _callback(-pending_error(_socket));
+                    }
+                ), true);
+            }
+            // _socket must already be non-blocking for the readiness based fallback;
+            // returns invalid_handler when the connect completed immediately
+            inline handler_id async_connect(socket _socket, const sockaddr *_address, socklen_t _length, completion_fn _callback) {
+                #if defined(UTIL_NET_HAS_IO_URING)
+                    if(mBackend == service_backend::io_uring)
+                    {
+                        io_uring_sqe *entry = prepare(_socket, IORING_OP_CONNECT, _callback);
+                        operation &op = mOperations[entry->user_data];
+                        memcpy(&op.address, _address, _length);
+                        entry->addr = (__u64)&op.address;
+                        entry->off = _length;
+                        return operation_id(entry->user_data);
+                    }
+                #endif
+                if(::connect(_socket, _address, _length) == 0)
+                {
+                    _callback(0);
+                    return invalid_handler;
+                }
+                if(errno != EINPROGRESS && !would_block(errno))
+                {
+                    _callback(-errno);
+                    return invalid_handler;
+                }
+                return add_handler(socket_event_handler(_socket, nullptr,
+                    [=](){
+                        _callback(-pending_error(_socket));
+                    },
+                    [=](){
+                        int error = pending_error(_socket);
+                        _callback(-(error != 0 ? error : ECONNREFUSED));
+                    }
+                ));
+            }
+            // the handler whose callback is running, invalid_handler outside of one
+            inline handler_id current_handler() const { return mCurrent; }
+            // runs _callback on the service thread once _milliseconds have passed
+            inline timer_id add_timer(int _milliseconds, std::function<void()> _callback) {
+                std::uint64_t now = internal::monotonic_clock();
+                if(mTimers.empty())
+                    mTimers.advance(now);
+                return mTimers.add(now + std::max(_milliseconds, 0), std::move(_callback));
+            }
+            inline bool cancel_timer(timer_id _id) {
+                return mTimers.cancel(_id);
+            }
+            inline std::size_t timer_count() const { return mTimers.size(); }
+            // waits at most _timeout milliseconds (-1: no limit), less when a timer is due
+            inline bool do_poll(int _timeout = 100) {
+                run_posted();
+                expire_timers();
+                if(mHandlerCount < 1 && mOperationCount < 1 && mTimers.empty()) return false;
+                wait(poll_timeout(_timeout));
+                expire_timers();
+                return true;
+            }
+            // runs until stop() is called; an idle service sleeps until new work is posted
+            inline void run(bool _abort_on_empty=false) {
+                while(!mStopped.load(std::memory_order_acquire))
+                {
+                    if(!do_poll(-1))
+                    {
+                        if(_abort_on_empty)
+                            return;
+                        wait(-1);
+                    }
+                }
+                mStopped.store(false, std::memory_order_release);
+            }
+            // the only members that may be called from other threads: _task is
+            // executed on the thread running the service
+            inline void post(std::function<void()> _task) {
+                bool first;
+                {
+                    std::lock_guard<std::mutex> lock(mPostedLock);
+                    first = mPosted.empty();
+                    mPosted.push_back(std::move(_task));
+                }
+                if(first)
+                    mWakeup.signal();
+            }
+            // for threads that cannot be sure the service outlives their post()
+            inline std::shared_ptr<service_link> link() const { return mLink; }
+            inline void stop() {
+                mStopped.store(true, std::memory_order_release);
+                mWakeup.signal();
+            }
+        private:
+            inline int poll_timeout(int _timeout) const {
+                std::uint64_t next = mTimers.next_expiry();
+                if(next == std::numeric_limits<std::uint64_t>::max())
+                    return _timeout;
+                std::uint64_t now = internal::monotonic_clock();
+                std::uint64_t remaining = next > now ? next - now : 0;
+                if(_timeout >= 0 && remaining >= (std::uint64_t)_timeout)
+                    return _timeout;
+                return (int)std::min<std::uint64_t>(remaining, std::numeric_limits<int>::max());
+            }
+            inline void run_posted() {
+                if(mPostedPending.empty())
+                {
+                    std::lock_guard<std::mutex> lock(mPostedLock);
+                    if(mPosted.empty())
+                        return;
+                    mPostedPending.swap(mPosted);
+                }
+                UTIL_NET_STAT(mStats.posted.add(mPostedPending.size()));
+                for(auto &task : mPostedPending)
+                    task();
+                mPostedPending.clear();
+            }
+            inline void expire_timers() {
+                auto expired = mTimers.advance(internal::monotonic_clock());
+                UTIL_NET_STAT(mStats.timers.add(expired));
+                (void)expired;
+            }
+            #if defined(UTIL_NET_ENABLE_STATS)
+            inline void record_wait(std::uint64_t _duration, int _events) {
+                mStats.polls.add();
+                mStats.poll_wait.record(_duration);
+                if(_events > 0)
+                    mStats.events.add(_events);
+                mStats.events_per_poll.record(_events > 0 ? _events : 0);
+            }
+            #endif
+            inline void wakeup() {
+                mWakeup.drain();
+                run_posted();
+            }
+            inline void wait(int _timeout) {
+                dispatch_scope scope(*this);
+                #if defined(UTIL_NET_HAS_IO_URING)
+                    if(mBackend == service_backend::io_uring)
+                    {
+                        do_uring(_timeout);
+                        return;
+                    }
+                #endif
+                #if defined(UTIL_NET_HAS_EPOLL)
+                    if(mBackend == service_backend::epoll)
+                    {
+                        do_epoll(_timeout);
+                        return;
+                    }
+                #endif
+                
+                mDescriptorList.clear();
+                for(auto i = std::begin(mDescriptors); i != std::end(mDescriptors);)
+                {
+                    if(i->second.handlers == 0)
+                    {
+                        i = mDescriptors.erase(i);
+                        continue;
+                    }
+                    poll_descriptor descriptor;
+                    descriptor.fd = i->first;
+                    descriptor.events = 0;
+                    descriptor.revents = 0;
+                    for(std::size_t index = i->second.first; index != npos; index = mSlots[index].next)
+                    {
+                        if(mSlots[index].reading)
+                            descriptor.events |= POLLIN;
+                        if(mSlots[index].writing)
+                            descriptor.events |= POLLOUT;
+                    }
+                    mDescriptorList.push_back(descriptor);
+                    i ++;
+                }
+                
+                poll_descriptor interrupt;
+                interrupt.fd = mWakeup.handle();
+                interrupt.events = POLLIN;
+                interrupt.revents = 0;
+                mDescriptorList.push_back(interrupt);
+                
+                UTIL_NET_STAT(std::uint64_t started = stats::now());
+                #if defined(_WIN32) || defined(_WIN64)
+                    auto result = ::WSAPoll(mDescriptorList.data(), mDescriptorList.size(), _timeout);
+                #else
+                    auto result = ::poll(mDescriptorList.data(), mDescriptorList.size(), _timeout);
+                #endif
+                UTIL_NET_STAT(record_wait(stats::now() - started, result));
+                
+                if(result < 0)
+                {
+                    if(errno == EINTR)
+                        return;
+                    __throw_error_with_number("error performing socket poll");
+                }
+                
+                if(mDescriptorList.back().revents != 0)
+                {
+                    result --;
+                    wakeup();
+                }
+                
+                for(unsigned int i = 0; i + 1 < mDescriptorList.size() && result > 0; i++)
+                {
+                    const poll_descriptor &descriptor = mDescriptorList[i];
+                    if(descriptor.revents == 0)
+                        continue;
+                    result --;
+                    dispatch(descriptor.fd,
+                        (descriptor.revents & (POLLIN | POLLHUP)) != 0,
+                        (descriptor.revents & (POLLOUT | POLLHUP)) != 0,
+                        (descriptor.revents & (POLLERR | POLLNVAL)) != 0);
+                }
+            }
+            static const std::size_t npos = (std::size_t)(-1);
+            static const handler_id operation_flag = (handler_id)1 << 63;
+            
+            // handlers live in stable slots chained per descriptor, so a
+            // handler_id (generation << 32 | slot) resolves in O(1)
+            struct handler_slot
+            {
+                inline handler_slot()
+                    : generation(1), previous(npos), next(npos), active(false),
+                      linked(false), persistent(false), reading(false), writing(false) {}
+                socket_event_handler handler;
+                std::uint32_t generation;
+                std::size_t previous;
+                std::size_t next;
+                bool active;
+                bool linked;
+                bool persistent;
+                bool reading;
+                bool writing;
+            };
+            struct descriptor_entry
+            {
+                inline descriptor_entry()
+                    : first(npos), last(npos), handlers(0), events(0), registered(false), changed(false) {}
+                std::size_t first;
+                std::size_t last;
+                std::size_t handlers;
+                std::vector<std::size_t> operations;
+                unsigned int events;
+                bool registered;
+                bool changed;
+            };
+            // slots released while callbacks run are recycled once the outermost
+            // dispatch returns, so a handler may safely cancel itself
+            struct dispatch_scope
+            {
+                inline dispatch_scope(service &_service) : mService(_service) { mService.mDepth ++; }
+                inline ~dispatch_scope() {
+                    if(--mService.mDepth == 0)
+                        mService.recycle();
+                }
+                service &mService;
+            };
+        private:
+            inline handler_slot *find_slot(handler_id _id) {
+                std::size_t index = (std::size_t)(_id & 0xffffffff);
+                if(index >= mSlots.size())
+                    return nullptr;
+                handler_slot &slot = mSlots[index];
+                if(!slot.active || slot.generation != (std::uint32_t)(_id >> 32))
+                    return nullptr;
+                return &slot;
+            }
+            inline void link(descriptor_entry &_entry, std::size_t _index) {
+                handler_slot &slot = mSlots[_index];
+                slot.previous = _entry.last;
+                slot.next = npos;
+                slot.linked = true;
+                if(_entry.last != npos)
+                    mSlots[_entry.last].next = _index;
+                else
+                    _entry.first = _index;
+                _entry.last = _index;
+                _entry.handlers ++;
+                mHandlerCount ++;
+            }
+            inline void unlink(descriptor_entry &_entry, std::size_t _index) {
+                handler_slot &slot = mSlots[_index];
+                if(slot.previous != npos)
+                    mSlots[slot.previous].next = slot.next;
+                else
+                    _entry.first = slot.next;
+                if(slot.next != npos)
+                    mSlots[slot.next].previous = slot.previous;
+                else
+                    _entry.last = slot.previous;
+                slot.previous = slot.next = npos;
+                slot.linked = false;
+                _entry.handlers --;
+                mHandlerCount --;
+            }
+            inline void release(std::size_t _index) {
+                mSlots[_index].active = false;
+                mReleased.push_back(_index);
+                if(mDepth == 0)
+                    recycle();
+            }
+            inline void recycle() {
+                for(std::size_t index : mReleased)
+                {
+                    handler_slot &slot = mSlots[index];
+                    slot.handler = socket_event_handler();
+                    slot.generation = (slot.generation + 1) & 0x7fffffff;
+                    if(slot.generation == 0)
+                        slot.generation = 1;
+                    mFreeSlots.push_back(index);
+                }
+                mReleased.clear();
+            }
+            inline void mark_changed(socket _socket, descriptor_entry &_entry) {
+                if(mBackend == service_backend::poll || _entry.changed)
+                    return;
+                _entry.changed = true;
+                mChanges.push_back(_socket);
+            }
+            // fires every handler of _socket interested in the reported condition,
+            // dropping the one-shot ones; errors are delivered to (and retire) all
+            inline void dispatch(socket _socket, bool _readable, bool _writable, bool _error) {
+                auto found = mDescriptors.find(_socket);
+                if(found == mDescriptors.end())
+                    return;
+                descriptor_entry &entry = found->second;
+                
+                std::size_t base = mFired.size();
+                for(std::size_t i = entry.first; i != npos;)
+                {
+                    handler_slot &slot = mSlots[i];
+                    std::size_t next = slot.next;
+                    if(_error || (_readable && slot.reading) || (_writable && slot.writing))
+                    {
+                        mFired.push_back(i);
+                        if(_error || !slot.persistent)
+                            unlink(entry, i);
+                    }
+                    i = next;
+                }
+                if(mFired.size() == base)
+                {
+                    #if defined(UTIL_NET_HAS_EPOLL)
+                        // a hang-up nobody listens for would be reported forever
+                        if(entry.handlers == 0 && entry.registered)
+                        {
+                            ::epoll_ctl(mPoller, EPOLL_CTL_DEL, _socket, nullptr);
+                            entry.registered = false;
+                            mark_changed(_socket, entry);
+                        }
+                    #endif
+                    return;
+                }
+                mark_changed(_socket, entry);
+                
+                // 'entry' may be invalidated by the callbacks from here on
+                for(std::size_t k = base; k < mFired.size(); k++)
+                {
+                    std::size_t index = mFired[k];
+                    handler_slot &slot = mSlots[index];
+                    if(!slot.active)
+                        continue;
+                    UTIL_NET_STAT(std::uint64_t started = stats::now());
+                    handler_id previous = mCurrent;
+                    mCurrent = ((handler_id)slot.generation << 32) | index;
+                    if(_error)
+                        slot.handler.on_error();
+                    else
+                    {
+                        if(_readable && slot.reading)
+                            slot.handler.on_read();
+                        if(_writable && slot.writing && slot.active)
+                            slot.handler.on_write();
+                    }
+                    mCurrent = previous;
+                    UTIL_NET_STAT(mStats.handlers.add(); mStats.callback_time.record(stats::now() - started));
+                    if(slot.active && !slot.linked)
+                        release(index);
+                }
+                mFired.resize(base);
+            }
+            #if defined(UTIL_NET_HAS_EPOLL)
+            inline void do_epoll(int _timeout) {
+                apply_changes();
+                
+                UTIL_NET_STAT(std::uint64_t started = stats::now());
+                auto result = ::epoll_wait(mPoller, mEvents.data(), mEvents.size(), _timeout);
+                UTIL_NET_STAT(record_wait(stats::now() - started, result));
+                if(result < 0)
+                {
+                    if(errno == EINTR)
+                        return;
+                    __throw_error_with_number("error performing socket poll");
+                }
+                
+                for(int i = 0; i < result; i++)
+                {
+                    const epoll_event &event = mEvents[i];
+                    if(event.data.fd == mWakeup.handle())
+                    {
+                        wakeup();
+                        continue;
+                    }
+                    dispatch(event.data.fd,
+                        (event.events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP)) != 0,
+                        (event.events & (EPOLLOUT | EPOLLHUP)) != 0,
+                        (event.events & EPOLLERR) != 0);
+                }
+                
+                if((unsigned int)result == mEvents.size() && mEvents.size() < 4096)
+                    mEvents.resize(mEvents.size() * 2);
+            }
+            // synchronises the kernel interest list with the pending handlers;
+            // a descriptor is only touched when its interest mask really changed,
+            // so re-arming the same kind of handler costs no system call
+            inline void apply_changes() {
+                mApplying.swap(mChanges);
+                for(socket changed : mApplying)
+                {
+                    auto found = mDescriptors.find(changed);
+                    if(found == mDescriptors.end())
+                        continue;
+                    descriptor_entry &entry = found->second;
+                    entry.changed = false;
+                    
+                    unsigned int events = 0;
+                    for(std::size_t index = entry.first; index != npos; index = mSlots[index].next)
+                    {
+                        if(mSlots[index].reading)
+                            events |= EPOLLIN | EPOLLRDHUP;
+                        if(mSlots[index].writing)
+                            events |= EPOLLOUT;
+                    }
+                    
+                    if(!entry.registered)
+                    {
+                        if(events == 0)
+                        {
+                            if(!entry.operations.empty())
+                                continue;
+                            mDescriptors.erase(found);
+                            continue;
+                        }
+                    }
+                    else if(events == entry.events)
+                        continue;
+                    
+                    epoll_event event;
+                    event.events = events;
+                    event.data.u64 = 0;
+                    event.data.fd = changed;
+                    
+                    int operation = entry.registered ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
+                    int result = ::epoll_ctl(mPoller, operation, changed, &event);
+                    // the descriptor may have been closed and reused behind our back
+                    if(result < 0 && errno == ENOENT)
+                        result = ::epoll_ctl(mPoller, EPOLL_CTL_ADD, changed, &event);
+                    else if(result < 0 && errno == EEXIST)
+                        result = ::epoll_ctl(mPoller, EPOLL_CTL_MOD, changed, &event);
+                    
+                    if(result < 0)
+                    {
+                        entry.registered = false;
+                        dispatch(changed, false, false, true);
+                        continue;
+                    }
+                    entry.registered = true;
+                    entry.events = events;
+                }
+                mApplying.clear();
+            }
+            #endif
+            #if defined(UTIL_NET_HAS_IO_URING)
+            struct operation
+            {
+                inline operation() : handle(invalid_socket), generation(1), cancelled(false) {}
+                completion_fn callback;
+                socket handle;
+                std::uint32_t generation;
+                bool cancelled;
+                sockaddr_storage address;
+            };
+            
+            static const __u64 poller_marker = ~(__u64)0;
+            static const __u64 cancel_marker = ~(__u64)1;
+            
+            inline io_uring_sqe *prepare(socket _socket, int _opcode, const completion_fn &_callback) {
+                io_uring_sqe *entry = mQueue.next();
+                if(entry == nullptr)
+                    __throw_error_with_number("failed to queue io_uring submission");
+                
+                std::size_t index;
+                if(!mFreeOperations.empty())
+                {
+                    index = mFreeOperations.back();
+                    mFreeOperations.pop_back();
+                }
+                else
+                {
+                    index = mOperations.size();
+                    mOperations.emplace_back();
+                }
+                operation &op = mOperations[index];
+                op.callback = _callback;
+                op.handle = _socket;
+                op.cancelled = false;
+                mDescriptors[_socket].operations.push_back(index);
+                mOperationCount ++;
+                
+                entry->opcode = _opcode;
+                entry->fd = _socket;
+                entry->user_data = index;
+                return entry;
+            }
+            inline handler_id operation_id(std::size_t _index) const {
+                return operation_flag | ((handler_id)mOperations[_index].generation << 32) | _index;
+            }
+            // the operation still completes, but its callback is dropped; the
+            // cancellation is submitted right away to keep it from racing with
+            // a completion that would consume data nobody receives
+            inline void cancel_operation(std::size_t _index) {
+                operation &op = mOperations[_index];
+                op.cancelled = true;
+                op.callback = nullptr;
+                detach_operation(_index);
+                io_uring_sqe *entry = mQueue.next();
+                if(entry != nullptr)
+                {
+                    entry->opcode = IORING_OP_ASYNC_CANCEL;
+                    entry->fd = -1;
+                    entry->addr = _index;
+                    entry->user_data = cancel_marker;
+                    mQueue.enter(0);
+                }
+            }
+            inline void detach_operation(std::size_t _index) {
+                operation &op = mOperations[_index];
+                if(op.handle == invalid_socket)
+                    return;
+                auto found = mDescriptors.find(op.handle);
+                if(found != mDescriptors.end())
+                {
+                    auto &operations = found->second.operations;
+                    for(auto &index : operations)
+                    {
+                        if(index == _index)
+                        {
+                            index = operations.back();
+                            operations.pop_back();
+                            break;
+                        }
+                    }
+                    mark_changed(op.handle, found->second);
+                }
+                op.handle = invalid_socket;
+            }
+            inline void complete(__u64 _user_data, int _result) {
+                if(_user_data == poller_marker)
+                {
+                    mPollerArmed = false;
+                    do_epoll(0);
+                    return;
+                }
+                if(_user_data == cancel_marker)
+                    return;
+                
+                operation &op = mOperations[_user_data];
+                completion_fn callback;
+                if(!op.cancelled)
+                    callback.swap(op.callback);
+                op.callback = nullptr;
+                detach_operation(_user_data);
+                op.generation = (op.generation + 1) & 0x7fffffff;
+                if(op.generation == 0)
+                    op.generation = 1;
+                mFreeOperations.push_back(_user_data);
+                mOperationCount --;
+                
+                if(callback)
+                {
+                    UTIL_NET_STAT(std::uint64_t started = stats::now());
+                    callback(_result);
+                    UTIL_NET_STAT(mStats.completions.add(); mStats.callback_time.record(stats::now() - started));
+                }
+            }
+            // one io_uring_enter() per tick submits every queued operation and
+            // waits for completions; readiness handlers arrive through a poll
+            // on the epoll descriptor
+            inline void do_uring(int _timeout) {
+                apply_changes();
+                
+                if(!mPollerArmed)
+                {
+                    io_uring_sqe *entry = mQueue.next();
+                    if(entry != nullptr)
+                    {
+                        entry->opcode = IORING_OP_POLL_ADD;
+                        entry->fd = mPoller;
+                        entry->poll_events = POLLIN;
+                        entry->user_data = poller_marker;
+                        mPollerArmed = true;
+                    }
+                }
+                
+                UTIL_NET_STAT(std::uint64_t started = stats::now());
+                if(mQueue.enter(_timeout == 0 ? 0 : 1, _timeout) < 0 && errno != EINTR && errno != EBUSY && errno != ETIME)
+                    __throw_error_with_number("error performing io_uring wait");
+                UTIL_NET_STAT(std::uint64_t waited = stats::now() - started);
+                
+                auto reaped = mQueue.reap([this](__u64 _user_data, int _result) {
+                    complete(_user_data, _result);
+                });
+                UTIL_NET_STAT(record_wait(waited, reaped));
+                (void)reaped;
+            }
+            #endif
+        private:
+            service_backend mBackend;
+            std::unordered_map<socket, descriptor_entry> mDescriptors;
+            std::vector<poll_descriptor> mDescriptorList;
+            std::vector<socket> mChanges;
+            std::vector<socket> mApplying;
+            std::deque<handler_slot> mSlots;
+            std::vector<std::size_t> mFreeSlots;
+            std::vector<std::size_t> mReleased;
+            std::vector<std::size_t> mFired;
+            unsigned int mDepth;
+            std::size_t mHandlerCount;
+            std::size_t mOperationCount;
+            socket mPoller;
+            handler_id mCurrent;
+            internal::timer_wheel mTimers;
+            internal::wakeup_descriptor mWakeup;
+            std::atomic<bool> mStopped;
+            std::mutex mPostedLock;
+            std::vector<std::function<void()>> mPosted;
+            std::vector<std::function<void()>> mPostedPending;
+            std::shared_ptr<service_link> mLink;
+            #if defined(UTIL_NET_ENABLE_STATS)
+                stats::service_stats mStats;
+            #endif
+            #if defined(UTIL_NET_HAS_EPOLL)
+                std::vector<epoll_event> mEvents;
+            #endif
+            #if defined(UTIL_NET_HAS_IO_URING)
+                internal::uring_queue mQueue;
+                std::deque<operation> mOperations;
+                std::vector<std::size_t> mFreeOperations;
+                bool mPollerArmed;
+            #endif
+        };
+        
+        inline socket_address make_address(const resolved_address &_resolved, int _port) {
+            socket_address addr;
+            memset(&addr, 0, sizeof(addr));
+            addr.sin_family = AF_INET;
+            addr.sin_port = htons(_port);
+            addr.sin_addr = ((const socket_address*)_resolved.data())->sin_addr;
+            return addr;
+        }
+        
+        inline socket_address make_address(const std::string &_hostname, int _port) {
+            return make_address(resolve_to_any(_hostname, AF_INET), _port);
+        }
+        
+        // resolves host names on worker threads so that no service ever blocks in
+        // getaddrinfo(). Answers are cached for _ttl milliseconds (getaddrinfo()
+        // does not report record lifetimes), failures for _negative_ttl, and
+        // concurrent lookups of a name share one query. Thread-safe; callbacks
+        // run on the thread of the service passed in and are dropped if that
+        // service is destroyed before the answer arrives
+        class resolver
+        {
+        public:
+            typedef std::vector<resolved_address> address_list;
+            // _error is 0 or the EAI_* code reported by getaddrinfo(); for
+            // EAI_SYSTEM errno holds the system error when the callback runs
+            typedef std::function<void(int,const address_list&)> resolve_fn;
+        public:
+            inline resolver(std::size_t _threads = 2, int _ttl = 60000, int _negative_ttl = 5000)
+                : mTtl(_ttl), mNegativeTtl(_negative_ttl), mStopping(false) {
+                for(std::size_t i = 0; i < std::max<std::size_t>(_threads, 1); i++)
+                    mWorkers.emplace_back([this](){ work(); });
+            }
+            resolver(const resolver&) = delete;
+            resolver &operator=(const resolver&) = delete;
+            inline ~resolver() {
+                {
+                    std::lock_guard<std::mutex> lock(mLock);
+                    mStopping = true;
+                }
+                mReady.notify_all();
+                for(auto &worker : mWorkers)
+                    worker.join();
+            }
+            // numeric addresses and cached names complete before this returns
+            inline void resolve_async(service &_service, const std::string &_hostname, int _family, resolve_fn _callback) {
+                address_list addresses;
+                if(lookup_host(_hostname, _family, AI_NUMERICHOST, addresses) == 0 && !addresses.empty())
+                {
+                    _callback(0, addresses);
+                    return;
+                }
+                
+                std::string key = cache_key(_hostname, _family);
+                std::unique_lock<std::mutex> lock(mLock);
+                std::uint64_t now = internal::monotonic_clock();
+                auto found = mCache.find(key);
+                if(found != mCache.end() && !found->second.pending && found->second.expires > now)
+                {
+                    int error = found->second.error;
+                    int system_error = found->second.system_error;
+                    std::shared_ptr<const address_list> cached = found->second.addresses;
+                    lock.unlock();
+                    errno = system_error;
+                    _callback(error, *cached);
+                    return;
+                }
+                if(found == mCache.end())
+                {
+                    if(mCache.size() >= max_entries)
+                        purge(now);
+                    found = mCache.emplace(key, entry()).first;
+                }
+                
+                entry &pending = found->second;
+                pending.waiters.push_back(waiter{_service.link(), std::move(_callback)});
+                if(pending.pending)
+                    return;
+                pending.pending = true;
+                mRequests.push_back(request{std::move(key), _hostname, _family});
+                lock.unlock();
+                mReady.notify_one();
+            }
+            // answers from the cache only; never blocks on the network
+            inline bool cached(const std::string &_hostname, int _family, address_list &_result) {
+                std::lock_guard<std::mutex> lock(mLock);
+                auto found = mCache.find(cache_key(_hostname, _family));
+                if(found == mCache.end() || found->second.pending || found->second.error != 0 ||
+                   found->second.expires <= internal::monotonic_clock())
+                    return false;
+                _result = *found->second.addresses;
+                return true;
+            }
+            inline void clear() {
+                std::lock_guard<std::mutex> lock(mLock);
+                purge(std::numeric_limits<std::uint64_t>::max());
+            }
+            // process wide instance used by client::connect_async()
+            static inline resolver &shared() {
+                static resolver instance;
+                return instance;
+            }
+        private:
+            static const std::size_t max_entries = 4096;
+            
+            struct waiter
+            {
+                std::shared_ptr<service_link> target;
+                resolve_fn callback;
+            };
+            struct entry
+            {
+                inline entry() : addresses(std::make_shared<address_list>()), error(0), system_error(0), expires(0), pending(false) {}
+                std::shared_ptr<const address_list> addresses;
+                int error;
+                int system_error;
+                std::uint64_t expires;
+                bool pending;
+                std::vector<waiter> waiters;
+            };
+            struct request
+            {
+                std::string key;
+                std::string hostname;
+                int family;
+            };
+            
+            static inline std::string cache_key(const std::string &_hostname, int _family) {
+                return _hostname + '/' + util::string::from(_family);
+            }
+            // drops the answers that expired by _now; lookups in flight stay
+            inline void purge(std::uint64_t _now) {
+                for(auto i = mCache.begin(); i != mCache.end();)
+                {
+                    if(!i->second.pending && i->second.expires <= _now)
+                        i = mCache.erase(i);
+                    else
+                        i ++;
+                }
+            }
+            inline void work() {
+                std::unique_lock<std::mutex> lock(mLock);
+                for(;;)
+                {
+                    mReady.wait(lock, [this](){ return mStopping || !mRequests.empty(); });
+                    if(mStopping)
+                        return;
+                    request next = std::move(mRequests.front());
+                    mRequests.pop_front();
+                    lock.unlock();
+                    
+                    std::shared_ptr<address_list> addresses = std::make_shared<address_list>();
+                    int error = lookup_host(next.hostname, next.family, AI_ADDRCONFIG, *addresses);
+                    // errno belongs to this thread, so it travels with the answer
+                    int system_error = 0;
+                    if(error == EAI_SYSTEM)
+                        system_error = errno != 0 ? errno : EIO;
+                    if(error == 0 && addresses->empty())
+                        error = EAI_NONAME;
+                    
+                    lock.lock();
+                    entry &answered = mCache[next.key];
+                    answered.addresses = addresses;
+                    answered.error = error;
+                    answered.system_error = system_error;
+                    answered.expires = internal::monotonic_clock() + (error == 0 ? mTtl : mNegativeTtl);
+                    answered.pending = false;
+                    std::vector<waiter> waiters;
+                    waiters.swap(answered.waiters);
+                    lock.unlock();
+                    
+                    for(auto &waiting : waiters)
+                    {
+                        resolve_fn callback = std::move(waiting.callback);
+                        waiting.target->post([callback, error, system_error, addresses](){
+                            errno = system_error;
+                            callback(error, *addresses);
+                        });
+                    }
+                    lock.lock();
+                }
+            }
+        private:
+            std::uint64_t mTtl;
+            std::uint64_t mNegativeTtl;
+            std::mutex mLock;
+            std::condition_variable mReady;
+            std::unordered_map<std::string, entry> mCache;
+            std::deque<request> mRequests;
+            std::vector<std::thread> mWorkers;
+            bool mStopping;
+        };
+        
+        // maps a service completion result onto the classic -1/errno convention
+        inline int completion_result(int _result) {
+            if(_result >= 0)
+                return _result;
+            errno = -_result;
+            return -1;
+        }
+        
+        // growable byte ring used to queue connection data; its contents are
+        // exposed as at most two iovec segments for scatter/gather I/O
+        class ring_buffer
+        {
+        public:
+            inline ring_buffer()
+                : mCapacity(0), mHead(0), mTail(0) {}
+            inline ring_buffer(ring_buffer &&_move)
+                : mData(std::move(_move.mData)), mCapacity(_move.mCapacity), mHead(_move.mHead), mTail(_move.mTail) {
+                _move.mCapacity = _move.mHead = _move.mTail = 0;
+            }
+            inline std::size_t size() const { return mTail - mHead; }
+            inline std::size_t capacity() const { return mCapacity; }
+            inline bool empty() const { return mHead == mTail; }
+            inline char operator[](std::size_t _index) const {
+                return mData[(mHead + _index) & (mCapacity - 1)];
+            }
+            // makes room for at least _count more bytes
+            inline void reserve(std::size_t _count) {
+                if(mCapacity - size() >= _count)
+                    return;
+                std::size_t capacity = mCapacity > 0 ? mCapacity : 4096;
+                while(capacity - size() < _count)
+                    capacity *= 2;
+                std::unique_ptr<char[]> data(new char[capacity]);
+                std::size_t count = size();
+                peek(data.get(), count);
+                mData.swap(data);
+                mCapacity = capacity;
+                mHead = 0;
+                mTail = count;
+            }
+            inline void write(const char *_data, std::size_t _count) {
+                reserve(_count);
+                std::size_t offset = mTail & (mCapacity - 1);
+                std::size_t first = std::min(_count, mCapacity - offset);
+                memcpy(mData.get() + offset, _data, first);
+                memcpy(mData.get(), _data + first, _count - first);
+                mTail += _count;
+            }
+            inline std::size_t peek(char *_data, std::size_t _count) const {
+                _count = std::min(_count, size());
+                if(_count == 0)
+                    return 0;
+                std::size_t offset = mHead & (mCapacity - 1);
+                std::size_t first = std::min(_count, mCapacity - offset);
+                memcpy(_data, mData.get() + offset, first);
+                memcpy(_data + first, mData.get(), _count - first);
+                return _count;
+            }
+            inline std::size_t read(char *_data, std::size_t _count) {
+                _count = peek(_data, _count);
+                consume(_count);
+                return _count;
+            }
+            inline void consume(std::size_t _count) {
+                mHead += std::min(_count, size());
+                if(mHead == mTail)
+                    mHead = mTail = 0;
+            }
+            // marks _count bytes of the free segments as filled
+            inline void commit(std::size_t _count) {
+                mTail += _count;
+            }
+            inline int data_segments(iovec _segments[2]) const {
+                return segments(_segments, mHead, size());
+            }
+            inline int free_segments(iovec _segments[2]) {
+                return segments(_segments, mTail, mCapacity - size());
+            }
+        private:
+            inline int segments(iovec _segments[2], std::size_t _start, std::size_t _count) const {
+                if(_count == 0)
+                    return 0;
+                std::size_t offset = _start & (mCapacity - 1);
+                std::size_t first = std::min(_count, mCapacity - offset);
+                _segments[0].iov_base = mData.get() + offset;
+                _segments[0].iov_len = first;
+                if(first == _count)
+                    return 1;
+                _segments[1].iov_base = mData.get();
+                _segments[1].iov_len = _count - first;
+                return 2;
+            }
+        private:
+            std::unique_ptr<char[]> mData;
+            std::size_t mCapacity;
+            std::size_t mHead;
+            std::size_t mTail;
+        };
+        
+        class client : public base_socket
+        {
+        public:
+            inline client(service &_service, socket _socket)
+                : base_socket(_service), mSocket(_socket), mReader(invalid_handler), mWriter(invalid_handler), mWriting(false) {
+                // TODO: derive IP string? o:
+                mIP = "some-ip-here";
+            }
+            inline client(service &_service)
+                : base_socket(_service), mSocket(invalid_socket), mReader(invalid_handler), mWriter(invalid_handler), mWriting(false) {}
+            // handlers and operations capture the client they were started on, so
+            // a client can only be moved while none are pending; otherwise this
+            // throws and _move is left untouched
+            inline client(client &&_move)
+                : base_socket(_move.mService), mSocket(take_over(_move)), mIP(_move.mIP),
+                  mReader(invalid_handler), mWriter(invalid_handler), mWriting(false),
+                  mSendBuffer(std::move(_move.mSendBuffer)), mReceiveBuffer(std::move(_move.mReceiveBuffer)) {}
+            inline ~client() {
+                close();
+            }
+            // the name is looked up through resolver::shared(), so the service
+            // never blocks on DNS; close() abandons a connect still resolving.
+            // The addresses are tried in the resolver's order, see connect()
+            inline void connect_async(const std::string &_target, int _port, std::function<void(client&,bool)> _callback) {
+                connect_async(_target, _port, -1, _callback);
+            }
+            // gives up after _timeout milliseconds (resolution included): the socket
+            // is closed and the callback reports failure with errno set to ETIMEDOUT
+            inline void connect_async(const std::string &_target, int _port, int _timeout, std::function<void(client&,bool)> _callback) {
+                if(mSocket != invalid_socket || mConnecting)
+                    throw socket_exception("socket already connected");
+                std::shared_ptr<deadline> state(new deadline());
+                mConnecting = state;
+                auto connected = [=](int _result){
+                    state->finished = true;
+                    mConnecting.reset();
+                    mService.cancel_timer(state->timer);
+                    if(_result == 0)
+                        mIP = _target;
+                    else
+                        errno = -_result;
+                    _callback(*this, _result == 0);
+                };
+                resolver::shared().resolve_async(mService, _target, AF_UNSPEC,
+                    [=](int _error, const resolver::address_list &_addresses){
+                        if(state->finished)
+                            return;
+                        if(_error != 0)
+                            return connected(_error == EAI_SYSTEM ? -errno : -EHOSTUNREACH);
+                        connect_next(state, std::make_shared<resolver::address_list>(_addresses), 0, _port, connected);
+                    }
+                );
+                if(!state->finished && _timeout >= 0)
+                    state->timer = mService.add_timer(_timeout, [=](){
+                        mService.cancel_handler(state->operation);
+                        close();
+                        errno = ETIMEDOUT;
+                        _callback(*this, false);
+                    });
+            }
+            // an address that refuses or cannot be reached is skipped for the next
+            // one _target resolves to, so e.g. "localhost" still reaches a server
+            // listening on IPv4 only where it resolves to ::1 first
+            inline bool connect(const std::string &_target, int _port) {
+                auto returnValue = invokeConnect(_target, _port);
+                if(returnValue != 0)
+                    return false;
+                mIP = _target;
+                return true;
+            }
+            inline void write_async(const std::string &_data, std::function<void(client&,int)> _callback) {
+                write_async(_data.c_str(), _data.length(), _callback);
+            }
+            inline void write_async(const char *_data, int _count, std::function<void(client&,int)> _callback) {
+                mService.async_send(mSocket, _data, _count,
+                    [=](int _result){
+                        int result = completion_result(_result);
+                        UTIL_NET_STAT(mStats.record_write(result));
+                        _callback(*this, result);
+                    }
+                );
+            }
+            inline int write(const std::string &_data) {
+                return write(_data.c_str(), _data.length());
+            }
+            inline int write(const char *_data, int _count) {
+                return retry_blocking(mSocket, POLLOUT, [&](){
+                    auto result = ::send(mSocket, _data, _count, MSG_DONTWAIT);
+                    UTIL_NET_STAT(mStats.record_write(result));
+                    return result;
+                });
+            }
+            inline void read_async(char *_data, int _size, std::function<void(client&,int)> _callback) {
+                mService.async_recv(mSocket, _data, _size,
+                    [=](int _result){
+                        int result = completion_result(_result);
+                        UTIL_NET_STAT(mStats.record_read(result));
+                        _callback(*this, result);
+                    }
+                );
+            }
+            // reports -1 with errno set to ETIMEDOUT when nothing arrived within
+            // _timeout milliseconds; the connection itself stays open. A negative
+            // _timeout means no deadline, as for connect_async()
+            inline void read_async(char *_data, int _size, int _timeout, std::function<void(client&,int)> _callback) {
+                std::shared_ptr<deadline> state(new deadline());
+                state->operation = mService.async_recv(mSocket, _data, _size,
+                    [=](int _result){
+                        mService.cancel_timer(state->timer);
+                        int result = completion_result(_result);
+                        UTIL_NET_STAT(mStats.record_read(result));
+                        _callback(*this, result);
+                    }
+                );
+                if(_timeout >= 0)
+                    state->timer = mService.add_timer(_timeout, [=](){
+                        mService.cancel_handler(state->operation);
+                        errno = ETIMEDOUT;
+                        _callback(*this, -1);
+                    });
+            }
+            inline int read(char *_data, int _size) {
+                return retry_blocking(mSocket, POLLIN, [&](){
+                    auto result = ::recv(mSocket, _data, _size, MSG_DONTWAIT);
+                    UTIL_NET_STAT(mStats.record_read(result));
+                    return result;
+                });
+            }
+            // keeps reading into _data until cancel() or close() without re-arming
+            // per chunk; end of stream or an error (result <= 0) ends the stream
+            inline handler_id read_stream(char *_data, int _size, std::function<void(client&,int)> _callback) {
+                std::shared_ptr<handler_id> id(new handler_id(invalid_handler));
+                *id = mService.add_handler(socket_event_handler(mSocket,
+                    [=](){
+                        auto result = ::recv(mSocket, _data, _size, MSG_DONTWAIT);
+                        UTIL_NET_STAT(mStats.record_read(result));
+                        if(result < 0 && would_block(errno))
+                            return;
+                        if(result <= 0)
+                            mService.cancel_handler(*id);
+                        _callback(*this, (int)result);
+                    }, nullptr,
+                    [=](){
+                        _callback(*this, completion_result(-pending_error(mSocket)));
+                    }
+                ), true);
+                return *id;
+            }
+            // copies _data into the send queue; everything queued until the socket
+            // turns writable goes out together and short writes are resumed.
+            // Data, files (write_file_async) and flush_async() callbacks are
+            // handled strictly in the order they were queued
+            inline void send(const char *_data, int _count) {
+                mSendBuffer.write(_data, _count);
+                if(mSteps.empty() || mSteps.back().file || mSteps.back().flushed)
+                    mSteps.emplace_back();
+                mSteps.back().bytes += _count;
+                arm_writer();
+            }
+            inline void send(const std::string &_data) {
+                send(_data.c_str(), _data.length());
+            }
+            // _callback runs once everything queued so far has been sent (or failed)
+            inline void flush_async(std::function<void(client&,bool)> _callback) {
+                if(!mWriting)
+                {
+                    _callback(*this, true);
+                    return;
+                }
+                mSteps.emplace_back();
+                mSteps.back().flushed = _callback;
+            }
+            inline std::size_t pending() const { return mSendBuffer.size(); }
+            // sends _count bytes of _file from _offset on without copying them
+            // through user memory (sendfile); blocks like write() and returns the
+            // number of bytes sent, less at the end of the file, or -1. A reset
+            // peer fails it with EPIPE, SIGPIPE is never raised
+            inline std::int64_t send_file(util::file::descriptor _file, std::int64_t _offset, std::size_t _count) {
+                #if defined(UTIL_NET_HAS_SENDFILE)
+                    internal::sigpipe_guard guard;
+                #endif
+                std::size_t sent = 0;
+                while(sent < _count)
+                {
+                    auto result = retry_blocking(mSocket, POLLOUT, [&](){
+                        return transmit_file(_file, _offset, _count - sent);
+                    });
+                    if(result < 0)
+                        return -1;
+                    if(result == 0)
+                        break;
+                    sent += result;
+                }
+                return (std::int64_t)sent;
+            }
+            // like send_file(), but queued behind everything sent before and
+            // resumed whenever the socket turns writable. _file has to stay open
+            // until _callback, which gets the byte count or -1 (errno); a failure
+            // also fails everything queued after it
+            inline void write_file_async(util::file::descriptor _file, std::int64_t _offset, std::size_t _count,
+                                         std::function<void(client&,std::int64_t)> _callback) {
+                std::shared_ptr<file_transfer> transfer(new file_transfer());
+                transfer->file = _file;
+                transfer->offset = _offset;
+                transfer->remaining = _count;
+                transfer->callback = _callback;
+                queue_file(transfer);
+            }
+            // sends a whole file by path; it is opened here and closed once the
+            // transfer is over or dropped by close()
+            inline void write_file_async(const std::string &_path, std::function<void(client&,std::int64_t)> _callback) {
+                util::file::descriptor file = util::file::open_descriptor(_path);
+                std::int64_t size = file != util::file::invalid_descriptor ? util::file::size(file) : -1;
+                if(size < 0)
+                {
+                    int error = errno;
+                    if(file != util::file::invalid_descriptor)
+                        util::file::close_descriptor(file);
+                    errno = error;
+                    _callback(*this, -1);
+                    return;
+                }
+                std::shared_ptr<file_transfer> transfer(new file_transfer());
+                transfer->file = file;
+                transfer->owned = true;
+                transfer->remaining = (std::size_t)size;
+                transfer->callback = _callback;
+                queue_file(transfer);
+            }
+            // reads whatever arrives into received() until cancel() or close();
+            // _callback gets the number of new bytes, <= 0 ends the stream
+            inline handler_id receive(std::function<void(client&,int)> _callback) {
+                mReader = mService.add_handler(socket_event_handler(mSocket,
+                    [=](){
+                        mReceiveBuffer.reserve(4096);
+                        iovec segments[2];
+                        msghdr message;
+                        memset(&message, 0, sizeof(message));
+                        message.msg_iov = segments;
+                        message.msg_iovlen = mReceiveBuffer.free_segments(segments);
+                        auto result = ::recvmsg(mSocket, &message, MSG_DONTWAIT);
+                        UTIL_NET_STAT(mStats.record_read(result));
+                        if(result < 0 && would_block(errno))
+                            return;
+                        if(result > 0)
+                            mReceiveBuffer.commit(result);
+                        else
+                        {
+                            mService.cancel_handler(mReader);
+                            mReader = invalid_handler;
+                        }
+                        _callback(*this, (int)result);
+                    }, nullptr,
+                    [=](){
+                        mReader = invalid_handler;
+                        _callback(*this, completion_result(-pending_error(mSocket)));
+                    }
+                ), true);
+                return mReader;
+            }
+            inline ring_buffer &received() { return mReceiveBuffer; }
+            inline void close() {
+                abandon_connect();
+                mService.remove_handlers(mSocket);
+                shutdown_socket(mSocket);
+                ::close(mSocket);
+                mSocket = invalid_socket;
+                mReader = mWriter = invalid_handler;
+                mWriting = false;
+                drop_writes();
+            }
+            // detaches the connection from this client (and its service) without
+            // closing it, e.g. to hand it over to another service
+            inline socket release() {
+                abandon_connect();
+                socket released = mSocket;
+                mService.remove_handlers(mSocket);
+                mSocket = invalid_socket;
+                mReader = mWriter = invalid_handler;
+                mWriting = false;
+                drop_writes();
+                return released;
+            }
+            inline const std::string &ip() const { return mIP; }
+            inline socket handle() const { return mSocket; }
+        private:
+            // shared between an operation and the timer bounding it
+            struct deadline
+            {
+                inline deadline() : operation(invalid_handler), timer(invalid_timer), finished(false) {}
+                handler_id operation;
+                timer_id timer;
+                bool finished;
+            };
+            
+            struct file_transfer
+            {
+                inline file_transfer() : file(-1), owned(false), offset(0), remaining(0), sent(0), error(0) {}
+                inline ~file_transfer() {
+                    if(owned)
+                        util::file::close_descriptor(file);
                 }
-                
-                #if defined(_WIN32) || defined(_WIN64)
-                    auto result = ::WSAPoll(descriptors.get(), handlers.size(), _timeout);
+                util::file::descriptor file;
+                // opened by write_file_async(path), so closed here
+                bool owned;
+                std::int64_t offset;
+                std::size_t remaining;
+                std::size_t sent;
+                int error;
+                std::function<void(client&,std::int64_t)> callback;
+            };
+            
+            // one entry of the outgoing stream: bytes queued by send() (still in
+            // mSendBuffer), a file, or a flush_async() callback
+            struct write_step
+            {
+                inline write_step() : bytes(0) {}
+                std::size_t bytes;
+                std::shared_ptr<file_transfer> file;
+                std::function<void(client&,bool)> flushed;
+            };
+            
+            // one sendfile() (or read and send where it is missing) from _offset,
+            // which is advanced by the bytes that went out; callers hold a
+            // sigpipe_guard around it
+            inline long long transmit_file(util::file::descriptor _file, std::int64_t &_offset, std::size_t _count) {
+                #if defined(UTIL_NET_HAS_SENDFILE)
+                    off_t offset = (off_t)_offset;
+                    auto result = ::sendfile(mSocket, _file, &offset, std::min<std::size_t>(_count, 1 << 30));
+                    UTIL_NET_STAT(mStats.record_write(result));
+                    if(result > 0)
+                        _offset = offset;
+                    return result;
                 #else
-                    auto result = ::poll(descriptors.get(), handlers.size(), _timeout);
+                    char buffer[65536];
+                    auto available = ::pread(_file, buffer, std::min(_count, sizeof(buffer)), (off_t)_offset);
+                    if(available <= 0)
+                        return available;
+                    #if defined(MSG_NOSIGNAL)
+                        auto result = ::send(mSocket, buffer, available, MSG_DONTWAIT | MSG_NOSIGNAL);
+                    #else
+                        auto result = ::send(mSocket, buffer, available, MSG_DONTWAIT);
+                    #endif
+                    UTIL_NET_STAT(mStats.record_write(result));
+                    if(result > 0)
+                        _offset += result;
+                    return result;
                 #endif
-                
-                if(result < 0)
-                    __throw_error_with_number("error performing socket poll");
-                
-                for(unsigned int i = 0; i < handlers.size() && result > 0; i++)
+            }
+            // sends until the socket would block; true once the transfer is over
+            inline bool continue_file(file_transfer &_transfer) {
+                #if defined(UTIL_NET_HAS_SENDFILE)
+                    internal::sigpipe_guard guard;
+                #endif
+                while(_transfer.remaining > 0)
                 {
-                    poll_descriptor &descriptor = descriptors.get()[i];
-                    
-                    if(!(descriptor.revents & POLLERR))
+                    auto result = transmit_file(_transfer.file, _transfer.offset, _transfer.remaining);
+                    if(result < 0 && would_block(errno))
+                        return false;
+                    if(result < 0)
                     {
-                        if(descriptor.revents & POLLIN || descriptor.revents & POLLOUT)
+                        _transfer.error = errno;
+                        return true;
+                    }
+                    if(result == 0)
+                        break;
+                    _transfer.sent += result;
+                    _transfer.remaining -= result;
+                }
+                return true;
+            }
+            // checks that _move can be moved from and returns its socket
+            static inline socket take_over(client &_move) {
+                if(_move.mConnecting || _move.mWriting)
+                    throw socket_exception("cannot move a client with pending operations");
+                // an idle writer is simply re-created by the next send()
+                if(_move.mWriter != invalid_handler)
+                {
+                    _move.mService.cancel_handler(_move.mWriter);
+                    _move.mWriter = invalid_handler;
+                }
+                if(_move.mSocket != invalid_socket && _move.mService.has_handlers(_move.mSocket))
+                    throw socket_exception("cannot move a client with pending operations");
+                socket result = _move.mSocket;
+                _move.mSocket = invalid_socket;
+                _move.mReader = invalid_handler;
+                return result;
+            }
+            inline void abandon_connect() {
+                if(!mConnecting)
+                    return;
+                mConnecting->finished = true;
+                mService.cancel_timer(mConnecting->timer);
+                mConnecting.reset();
+            }
+            // connects to (*_addresses)[_index] and falls through to the following
+            // addresses like connect() does
+            inline void connect_next(std::shared_ptr<deadline> _state, std::shared_ptr<const resolver::address_list> _addresses,
+                                     std::size_t _index, int _port, std::function<void(int)> _connected) {
+                resolved_address addr = (*_addresses)[_index];
+                addr.set_port(_port);
+                bool last = _index + 1 >= _addresses->size();
+                mSocket = create_socket(addr.family, SOCK_STREAM, IPPROTO_TCP);
+                if(mSocket == invalid_socket)
+                {
+                    if(!last && try_next_address(errno))
+                        return connect_next(_state, _addresses, _index + 1, _port, _connected);
+                    return _connected(-errno);
+                }
+                _state->operation = mService.async_connect(mSocket, addr.data(), addr.length,
+                    [=](int _result){
+                        if(_result < 0 && !last && try_next_address(-_result))
                         {
-                            result --;
-                            preserve_flags.get()[i] = false;
-                            if(descriptor.revents & POLLIN)
-                                handlers[i].on_read();
-                            if(descriptor.revents & POLLOUT)
-                                handlers[i].on_write();
+                            discard_socket();
+                            return connect_next(_state, _addresses, _index + 1, _port, _connected);
+                        }
+                        _connected(_result);
+                    }
+                );
+            }
+            // failures that are specific to one address of a name
+            static inline bool try_next_address(int _error) {
+                return (_error == ECONNREFUSED || _error == EAFNOSUPPORT || _error == ENETUNREACH ||
+                        _error == EHOSTUNREACH || _error == EADDRNOTAVAIL);
+            }
+            // closes the socket of a failed connect attempt
+            inline void discard_socket() {
+                mService.remove_handlers(mSocket);
+                ::close(mSocket);
+                mSocket = invalid_socket;
+            }
+            inline void queue_file(const std::shared_ptr<file_transfer> &_transfer) {
+                mSteps.emplace_back();
+                mSteps.back().file = _transfer;
+                arm_writer();
+            }
+            inline void arm_writer() {
+                if(mWriting)
+                    return;
+                if(mWriter == invalid_handler)
+                    mWriter = mService.add_handler(socket_event_handler(mSocket, nullptr,
+                        [this](){
+                            flush();
+                        },
+                        [this](){
+                            // the error already retired the writer
+                            mWriter = invalid_handler;
+                            fail_writes(pending_error(mSocket));
                         }
+                    ), true);
+                else
+                    mService.modify_handler(mWriter, false, true);
+                mWriting = true;
+            }
+            // works through mSteps until the socket would block or all went out
+            inline void flush() {
+                while(!mSteps.empty())
+                {
+                    write_step &step = mSteps.front();
+                    if(step.file)
+                    {
+                        if(!continue_file(*step.file))
+                            return;
+                        if(step.file->error != 0)
+                            return fail_writes(step.file->error);
+                        std::shared_ptr<file_transfer> transfer = step.file;
+                        mSteps.pop_front();
+                        transfer->callback(*this, (std::int64_t)transfer->sent);
+                    }
+                    else if(step.flushed)
+                    {
+                        std::function<void(client&,bool)> callback;
+                        callback.swap(step.flushed);
+                        mSteps.pop_front();
+                        callback(*this, true);
                     }
                     else
                     {
-                        result --;
-                        preserve_flags.get()[i] = false;
-                        handlers[i].on_error();
+                        while(step.bytes > 0)
+                        {
+                            iovec segments[2];
+                            msghdr message;
+                            memset(&message, 0, sizeof(message));
+                            message.msg_iov = segments;
+                            message.msg_iovlen = limit_segments(segments, mSendBuffer.data_segments(segments), step.bytes);
+                            #if defined(MSG_NOSIGNAL)
+                                auto result = ::sendmsg(mSocket, &message, MSG_DONTWAIT | MSG_NOSIGNAL);
+                            #else
+                                auto result = ::sendmsg(mSocket, &message, MSG_DONTWAIT);
+                            #endif
+                            UTIL_NET_STAT(mStats.record_write(result));
+                            if(result < 0)
+                            {
+                                if(!would_block(errno))
+                                    fail_writes(errno);
+                                return;
+                            }
+                            mSendBuffer.consume(result);
+                            step.bytes -= result;
+                        }
+                        mSteps.pop_front();
                     }
                 }
-                
-                for(unsigned int i = 0; i < handlers.size(); i++)
+                mService.modify_handler(mWriter, false, false);
+                mWriting = false;
+            }
+            // trims _segments so that they cover no more than _limit bytes
+            static inline std::size_t limit_segments(iovec *_segments, std::size_t _count, std::size_t _limit) {
+                for(std::size_t i = 0; i < _count; i++)
                 {
-                    if(preserve_flags.get()[i])
+                    if(_segments[i].iov_len >= _limit)
                     {
-                        add_handler(handlers[i]);
+                        _segments[i].iov_len = _limit;
+                        return i + 1;
                     }
+                    _limit -= _segments[i].iov_len;
                 }
-                
-                return true;
+                return _count;
             }
-            inline void run(bool _abort_on_empty=false) {
-                while(do_poll(1000) || !_abort_on_empty);
+            // a failed write leaves the stream in an unknown state, so everything
+            // still queued fails with it
+            inline void fail_writes(int _error) {
+                // a failed sendmsg() gets no EPOLLERR (e.g. EPIPE after a local
+                // shutdown), so the persistent writer has to be dropped here
+                if(mWriter != invalid_handler)
+                    mService.cancel_handler(mWriter);
+                mWriter = invalid_handler;
+                mWriting = false;
+                mSendBuffer.consume(mSendBuffer.size());
+                std::deque<write_step> failed;
+                failed.swap(mSteps);
+                for(auto &step : failed)
+                {
+                    errno = _error;
+                    if(step.file)
+                        step.file->callback(*this, -1);
+                    else if(step.flushed)
+                        step.flushed(*this, false);
+                }
+            }
+            // forgets queued writes without reporting them (close(), release())
+            inline void drop_writes() {
+                mSendBuffer.consume(mSendBuffer.size());
+                mSteps.clear();
+            }
+            inline void createSocket(int _family = AF_INET) {
+                if(mSocket != invalid_socket)
+                    throw socket_exception("socket already connected");
+                mSocket = create_socket(_family, SOCK_STREAM, IPPROTO_TCP);
+                if(mSocket == invalid_socket)
+                    __throw_error_with_number("failed to create socket");
+            }
+            inline int invokeConnect(const std::string &_target, int _port) {
+                if(mSocket != invalid_socket)
+                    throw socket_exception("socket already connected");
+                auto addresses = resolve(_target);
+                if(addresses.empty())
+                    throw socket_exception("unable to resolve hostname '" + _target + "'");
+                for(auto next = addresses.begin(); ;)
+                {
+                    resolved_address addr = *next;
+                    addr.set_port(_port);
+                    bool last = ++next == addresses.end();
+                    mSocket = create_socket(addr.family, SOCK_STREAM, IPPROTO_TCP);
+                    if(mSocket == invalid_socket)
+                    {
+                        if(!last && try_next_address(errno))
+                            continue;
+                        __throw_error_with_number("failed to create socket");
+                    }
+                    int result = connect_blocking(mSocket, addr.data(), addr.length);
+                    if(result == 0 || last || !try_next_address(errno))
+                        return result;
+                    discard_socket();
+                }
             }
         private:
-            std::list<socket_event_handler> mHandlers;
+            socket mSocket;
+            std::string mIP;
+            handler_id mReader;
+            handler_id mWriter;
+            bool mWriting;
+            ring_buffer mSendBuffer;
+            ring_buffer mReceiveBuffer;
+            std::deque<write_step> mSteps;
+            std::shared_ptr<deadline> mConnecting;
         };
         
-        class client : public base_socket
+        // keeps outbound connections per (host, port) endpoint open for reuse.
+        // An endpoint has at most _per_endpoint connections, further acquire()
+        // calls wait for one to be released; at most _max_idle connections idle
+        // overall, the least recently released are closed first. An idle
+        // connection that turns readable (closed by the peer or out of sync) is
+        // dropped right away, one idle for _idle_timeout milliseconds as well.
+        // Like its service, a pool may only be used from the service thread
+        class connection_pool
         {
         public:
-            inline client(service &_service, socket _socket) : base_socket(_service), mSocket(_socket) {
-                // TODO: derive IP string? o:
-                mIP = "some-ip-here";
+            typedef std::unique_ptr<client> connection;
+            // receives nullptr, with errno set, when connecting failed
+            typedef std::function<void(connection)> acquire_fn;
+        public:
+            inline connection_pool(service &_service, std::size_t _per_endpoint = 8, std::size_t _max_idle = 256,
+                                   int _idle_timeout = 30000, int _connect_timeout = 5000)
+                : mService(_service), mPerEndpoint(std::max<std::size_t>(_per_endpoint, 1)), mMaxIdle(_max_idle),
+                  mIdleTimeout(_idle_timeout), mConnectTimeout(_connect_timeout) {}
+            connection_pool(const connection_pool&) = delete;
+            connection_pool &operator=(const connection_pool&) = delete;
+            inline ~connection_pool() {
+                clear();
+                mConnecting.clear();
             }
-            inline client(service &_service) : base_socket(_service), mSocket(invalid_socket) {}
-            inline client(client &&_move)
-                : base_socket(_move.mService), mSocket(_move.mSocket), mIP(_move.mIP) {
-                _move.mSocket = invalid_socket;
+            inline void acquire(const std::string &_host, int _port, acquire_fn _callback) {
+                std::string key = _host + ':' + util::string::from(_port);
+                endpoint &target = mEndpoints[key];
+                if(target.host.empty())
+                {
+                    target.host = _host;
+                    target.port = _port;
+                }
+                while(!target.idle.empty())
+                {
+                    idle_iterator entry = target.idle.back();
+                    target.idle.pop_back();
+                    connection link = detach(entry);
+                    if(healthy(*link))
+                    {
+                        hand_out(key, std::move(link), _callback);
+                        return;
+                    }
+                    target.open --;
+                }
+                if(target.open >= mPerEndpoint)
+                {
+                    target.waiting.push_back(std::move(_callback));
+                    return;
+                }
+                connect(key, target, std::move(_callback));
             }
-            inline ~client() {
-                close();
+            // every acquired connection has to come back here; one that failed or
+            // is not in a reusable state (e.g. a response was not fully read) must
+            // be released with _reusable = false so that it is closed
+            inline void release(connection _connection, bool _reusable = true) {
+                if(!_connection)
+                    return;
+                auto found = mActive.find(_connection.get());
+                if(found == mActive.end())
+                    return;
+                std::string key = std::move(found->second);
+                mActive.erase(found);
+                
+                endpoint &target = mEndpoints[key];
+                if(!_reusable || _connection->pending() > 0 || !healthy(*_connection))
+                {
+                    _connection.reset();
+                    closed(key);
+                    return;
+                }
+                if(!target.waiting.empty())
+                {
+                    acquire_fn next = std::move(target.waiting.front());
+                    target.waiting.pop_front();
+                    hand_out(key, std::move(_connection), next);
+                    return;
+                }
+                park(key, target, std::move(_connection));
             }
-            inline void connect_async(const std::string &_target, int _port, std::function<void(client&,bool)> _callback) {
-                make_nonblocking(mSocket);
-                invokeConnect(_target, _port);
-                mService.add_handler(socket_event_handler(mSocket, nullptr,
-                    [=](){
-                        _callback(*this, true);
-                    },
-                    [=](){
-                        _callback(*this, false);
-                    }
-                ));
+            // closes every idle connection
+            inline void clear() {
+                while(!mIdle.empty())
+                    evict(mIdle.begin());
             }
-            inline bool connect(const std::string &_target, int _port) {
-                make_blocking(mSocket);
-                auto returnValue = invokeConnect(_target, _port);
-                if(returnValue != 0)
-                    return false;
-                mIP = _target;
-                return true;
+            inline std::size_t idle() const { return mIdle.size(); }
+            inline std::size_t open(const std::string &_host, int _port) const {
+                auto found = mEndpoints.find(_host + ':' + util::string::from(_port));
+                return found != mEndpoints.end() ? found->second.open : 0;
             }
-            inline void write_async(const std::string &_data, std::function<void(client&,int)> _callback) {
-                write_async(_data.c_str(), _data.length(), _callback);
+        private:
+            struct idle_connection
+            {
+                std::string key;
+                connection link;
+                handler_id watcher;
+                timer_id timer;
+            };
+            typedef std::list<idle_connection>::iterator idle_iterator;
+            struct endpoint
+            {
+                inline endpoint() : port(0), open(0) {}
+                std::string host;
+                int port;
+                std::size_t open;
+                std::vector<idle_iterator> idle;
+                std::deque<acquire_fn> waiting;
+            };
+            
+            static inline bool healthy(const client &_link) {
+                char byte;
+                auto result = ::recv(_link.handle(), &byte, 1, MSG_PEEK | MSG_DONTWAIT);
+                return result < 0 && would_block(errno);
             }
-            inline void write_async(const char *_data, int _count, std::function<void(client&,int)> _callback) {
-                make_nonblocking(mSocket);
-                mService.add_handler(socket_event_handler(mSocket, nullptr,
-                    [=](){
-                        auto result = write(_data, _count);
-                        _callback(*this, result);
-                    },
-                    [=](){
-                        _callback(*this, 0);
+            inline void hand_out(const std::string &_key, connection _link, const acquire_fn &_callback) {
+                mActive[_link.get()] = _key;
+                _callback(std::move(_link));
+            }
+            inline void connect(const std::string &_key, endpoint &_target, acquire_fn _callback) {
+                _target.open ++;
+                connection link(new client(mService));
+                client *pending = link.get();
+                mConnecting[pending] = std::move(link);
+                pending->connect_async(_target.host, _target.port, mConnectTimeout,
+                    [this, _key, _callback](client &_client, bool _success){
+                        auto found = mConnecting.find(&_client);
+                        connection connected = std::move(found->second);
+                        mConnecting.erase(found);
+                        if(_success)
+                        {
+                            hand_out(_key, std::move(connected), _callback);
+                            return;
+                        }
+                        int error = errno;
+                        connected.reset();
+                        closed(_key);
+                        errno = error;
+                        _callback(nullptr);
                     }
-                ));
+                );
             }
-            inline int write(const std::string &_data) {
-                return write(_data.c_str(), _data.length());
+            // a connection of _key is gone; a waiting acquire() may open the next
+            inline void closed(const std::string &_key) {
+                endpoint &target = mEndpoints[_key];
+                target.open --;
+                if(target.waiting.empty())
+                    return;
+                acquire_fn next = std::move(target.waiting.front());
+                target.waiting.pop_front();
+                connect(_key, target, std::move(next));
             }
-            inline int write(const char *_data, int _count) {
-                make_blocking(mSocket);
-                return ::send(mSocket, _data, _count, 0);
+            inline void park(const std::string &_key, endpoint &_target, connection _link) {
+                idle_iterator entry = mIdle.insert(mIdle.end(), idle_connection());
+                entry->key = _key;
+                entry->link = std::move(_link);
+                entry->watcher = mService.add_handler(socket_event_handler(entry->link->handle(),
+                    [this, entry](){ evict(entry); }, nullptr,
+                    [this, entry](){ evict(entry); }
+                ), true);
+                entry->timer = mService.add_timer(mIdleTimeout, [this, entry](){ evict(entry); });
+                _target.idle.push_back(entry);
+                
+                if(mIdle.size() > mMaxIdle)
+                    evict(mIdle.begin());
             }
-            inline void read_async(char *_data, int _size, std::function<void(client&,int)> _callback) {
-                make_nonblocking(mSocket);
-                mService.add_handler(socket_event_handler(mSocket,
-                    [=](){
-                        auto result = read(_data, _size);
-                        _callback(*this, result);
-                    }, nullptr,
-                    [=](){
-                        _callback(*this, 0);
-                    }
-                ));
+            inline connection detach(idle_iterator _entry) {
+                mService.cancel_handler(_entry->watcher);
+                mService.cancel_timer(_entry->timer);
+                connection link = std::move(_entry->link);
+                mIdle.erase(_entry);
+                return link;
             }
-            inline int read(char *_data, int _size) {
-                make_blocking(mSocket);
-                return ::recv(mSocket, _data, _size, 0);
+            inline void evict(idle_iterator _entry) {
+                std::string key = _entry->key;
+                auto &idle = mEndpoints[key].idle;
+                idle.erase(std::find(idle.begin(), idle.end(), _entry));
+                detach(_entry).reset();
+                closed(key);
             }
-            inline void close() {
-                shutdown_socket(mSocket);
-                ::close(mSocket);
-                mSocket = invalid_socket;
+        private:
+            service &mService;
+            std::size_t mPerEndpoint;
+            std::size_t mMaxIdle;
+            int mIdleTimeout;
+            int mConnectTimeout;
+            std::unordered_map<std::string, endpoint> mEndpoints;
+            std::list<idle_connection> mIdle;
+            std::unordered_map<client*, std::string> mActive;
+            std::unordered_map<client*, connection> mConnecting;
+        };
+
+        // preallocated arena of datagram slots for udp_client::read_batch() and
+        // write_batch(); a batch is reused across calls without allocating
+        class datagram_batch
+        {
+            friend class udp_client;
+        public:
+            // largest UDP payload, and so the largest GRO coalesced read
+            static const std::size_t max_datagram = 65535;
+            
+            inline datagram_batch(std::size_t _capacity = 64, std::size_t _slot_size = 2048)
+                : mCapacity(_capacity), mSlotSize(_slot_size), mSize(0),
+                  mArena(new char[_capacity * _slot_size]), mLengths(_capacity), mSegments(_capacity),
+                  mTruncated(_capacity), mAddresses(_capacity), mControl(_capacity * control_size)
+                #if defined(UTIL_NET_HAS_MMSG)
+                  , mHeaders(_capacity), mVectors(_capacity)
+                #endif
+                {}
+            inline std::size_t capacity() const { return mCapacity; }
+            inline std::size_t slot_size() const { return mSlotSize; }
+            inline std::size_t size() const { return mSize; }
+            inline bool empty() const { return mSize == 0; }
+            inline bool full() const { return mSize == mCapacity; }
+            inline void clear() { mSize = 0; }
+            // grows every slot to at least _slot_size bytes; empties the batch
+            inline void reserve_slots(std::size_t _slot_size) {
+                mSize = 0;
+                if(_slot_size <= mSlotSize)
+                    return;
+                mArena.reset(new char[mCapacity * _slot_size]);
+                mSlotSize = _slot_size;
+            }
+            inline char *data(std::size_t _index) { return mArena.get() + _index * mSlotSize; }
+            inline const char *data(std::size_t _index) const { return mArena.get() + _index * mSlotSize; }
+            inline std::size_t length(std::size_t _index) const { return mLengths[_index]; }
+            inline const socket_address &address(std::size_t _index) const { return mAddresses[_index]; }
+            // size of the segments a GRO coalesced datagram consists of, 0 otherwise
+            // (also when it was truncated, as the last segment is then incomplete)
+            inline std::size_t segment_size(std::size_t _index) const { return mSegments[_index]; }
+            // whether the datagram did not fit its slot; length() is what was kept
+            inline bool truncated(std::size_t _index) const { return mTruncated[_index] != 0; }
+            // queues a copy of _data for write_batch(); false when full or too large
+            inline bool push(const char *_data, std::size_t _count, const socket_address &_target) {
+                if(full() || _count > mSlotSize)
+                    return false;
+                memcpy(data(mSize), _data, _count);
+                mLengths[mSize] = _count;
+                mSegments[mSize] = 0;
+                mTruncated[mSize] = 0;
+                mAddresses[mSize] = _target;
+                mSize ++;
+                return true;
             }
-            inline const std::string &ip() const { return mIP; }
         private:
-            inline int invokeConnect(const std::string &_target, int _port) {
-                if(mSocket != invalid_socket)
-                    throw socket_exception("socket already connected");
-                mSocket = ::socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
-                if(mSocket == invalid_socket)
-                    __throw_error_with_number("failed to create socket");
-                address_info resolved = resolve_to_any(_target);
-                socket_address addr;
-                addr.sin_family = AF_INET;
-                addr.sin_port = htons(_port);
-                addr.sin_addr = ((socket_address*)resolved.ai_addr)->sin_addr;
-                return ::connect(mSocket, (sockaddr*)&addr, sizeof(addr));
+            #if defined(UDP_GRO)
+                static const std::size_t control_size = CMSG_SPACE(sizeof(int));
+            #else
+                static const std::size_t control_size = 0;
+            #endif
+            #if defined(UTIL_NET_HAS_MMSG)
+            inline mmsghdr *prepare(std::size_t _first, std::size_t _count, bool _receiving) {
+                for(std::size_t i = _first; i < _first + _count; i++)
+                {
+                    msghdr &header = mHeaders[i].msg_hdr;
+                    mVectors[i].iov_base = data(i);
+                    mVectors[i].iov_len = _receiving ? mSlotSize : mLengths[i];
+                    header.msg_name = &mAddresses[i];
+                    header.msg_namelen = sizeof(socket_address);
+                    header.msg_iov = &mVectors[i];
+                    header.msg_iovlen = 1;
+                    header.msg_control = (_receiving && control_size > 0) ? &mControl[i * control_size] : nullptr;
+                    header.msg_controllen = _receiving ? control_size : 0;
+                    header.msg_flags = 0;
+                    mHeaders[i].msg_len = 0;
+                }
+                return &mHeaders[_first];
+            }
+            inline void received(std::size_t _count) {
+                for(std::size_t i = 0; i < _count; i++)
+                {
+                    mLengths[i] = mHeaders[i].msg_len;
+                    mSegments[i] = 0;
+                    #if defined(UDP_GRO)
+                        msghdr &header = mHeaders[i].msg_hdr;
+                        for(cmsghdr *control = CMSG_FIRSTHDR(&header); control != nullptr; control = CMSG_NXTHDR(&header, control))
+                        {
+                            if(control->cmsg_level == SOL_UDP && control->cmsg_type == UDP_GRO)
+                            {
+                                int segment;
+                                memcpy(&segment, CMSG_DATA(control), sizeof(segment));
+                                mSegments[i] = segment;
+                            }
+                        }
+                    #endif
+                    mTruncated[i] = (mHeaders[i].msg_hdr.msg_flags & MSG_TRUNC) != 0;
+                    if(mTruncated[i])
+                        mSegments[i] = 0;
+                }
+                mSize = _count;
             }
+            #endif
         private:
-            socket mSocket;
-            std::string mIP;
+            std::size_t mCapacity;
+            std::size_t mSlotSize;
+            std::size_t mSize;
+            std::unique_ptr<char[]> mArena;
+            std::vector<std::size_t> mLengths;
+            std::vector<std::size_t> mSegments;
+            std::vector<char> mTruncated;
+            std::vector<socket_address> mAddresses;
+            std::vector<char> mControl;
+            #if defined(UTIL_NET_HAS_MMSG)
+                std::vector<mmsghdr> mHeaders;
+                std::vector<iovec> mVectors;
+            #endif
         };
-
-        socket_address make_address(const std::string &_hostname, int _port) {
-            address_info resolved = resolve_to_any(_hostname);
-            socket_address addr;
-            addr.sin_family = AF_INET;
-            addr.sin_port = htons(_port);
-            addr.sin_addr = ((socket_address*)resolved.ai_addr)->sin_addr;
-            return addr;
-        }
-
+        
         class udp_client : public base_socket {
         public:
-            inline udp_client(service &_service, socket _socket) : base_socket(_service), mSocket(_socket) {
+            inline udp_client(service &_service, socket _socket) : base_socket(_service), mSocket(_socket), mGro(false) {
                 // TODO: derive IP string? o:
                 mIP = "some-ip-here";
             }
-            inline udp_client(service &_service) : base_socket(_service), mSocket(::socket(AF_INET, SOCK_DGRAM, 0)) {}
+            inline udp_client(service &_service) : base_socket(_service), mSocket(create_socket(AF_INET, SOCK_DGRAM, 0)), mGro(false) {}
             inline udp_client(udp_client &&_move)
-                : base_socket(_move.mService), mSocket(_move.mSocket), mIP(_move.mIP) {
+                : base_socket(_move.mService), mSocket(_move.mSocket), mIP(_move.mIP), mGro(_move.mGro) {
                 _move.mSocket = invalid_socket;
             }
             inline ~udp_client() {
@@ -363,11 +3129,11 @@ namespace util
                 write_async(_data.c_str(), _data.length(), _target, _callback);
             }
             inline void write_async(const char *_data, int _count, socket_address _target, std::function<void(udp_client&,int)> _callback) {
-                make_nonblocking(mSocket);
                 mService.add_handler(socket_event_handler(mSocket, nullptr,
                     [=](){
-                        auto result = write(_data, _count, _target);
-                        _callback(*this, result);
+                        auto result = ::sendto(mSocket, _data, _count, MSG_DONTWAIT, (sockaddr*) &_target, sizeof(_target));
+                        UTIL_NET_STAT(mStats.record_write(result));
+                        _callback(*this, (int)result);
                     },
                     [=](){
                         _callback(*this, 0);
@@ -378,15 +3144,19 @@ namespace util
                 return write(_data.c_str(), _data.length(), _target);
             }
             inline int write(const char *_data, int _count, socket_address _target) {
-                make_blocking(mSocket);
-                return ::sendto(mSocket, _data, _count, 0, (sockaddr*) &_target, sizeof(_target));
+                return retry_blocking(mSocket, POLLOUT, [&](){
+                    auto result = ::sendto(mSocket, _data, _count, MSG_DONTWAIT, (sockaddr*) &_target, sizeof(_target));
+                    UTIL_NET_STAT(mStats.record_write(result));
+                    return result;
+                });
             }
             inline void read_async(char *_data, int _size, socket_address &_target, std::function<void(udp_client&,int)> _callback) {
-                make_nonblocking(mSocket);
                 mService.add_handler(socket_event_handler(mSocket,
                     [=, &_target](){
-                        auto result = read(_data, _size, _target);
-                        _callback(*this, result);
+                        socklen_t length = sizeof(_target);
+                        auto result = ::recvfrom(mSocket, _data, _size, MSG_DONTWAIT, (sockaddr*) &_target, &length);
+                        UTIL_NET_STAT(mStats.record_read(result));
+                        _callback(*this, (int)result);
                     }, nullptr,
                     [=](){
                         _callback(*this, 0);
@@ -394,11 +3164,159 @@ namespace util
                 ));
             }
             inline int read(char *_data, int _size, socket_address &_target) {
-                make_blocking(mSocket);
-                unsigned int length = sizeof(_target);
-                return ::recvfrom(mSocket, _data, _size, 0, (sockaddr*) &_target, &length);
+                return retry_blocking(mSocket, POLLIN, [&](){
+                    socklen_t length = sizeof(_target);
+                    auto result = ::recvfrom(mSocket, _data, _size, MSG_DONTWAIT, (sockaddr*) &_target, &length);
+                    UTIL_NET_STAT(mStats.record_read(result));
+                    return result;
+                });
+            }
+            // delivers every datagram received into _data, together with its
+            // sender, until cancel() or close()
+            inline handler_id read_stream(char *_data, int _size, std::function<void(udp_client&,int,const socket_address&)> _callback) {
+                return mService.add_handler(socket_event_handler(mSocket,
+                    [=](){
+                        socket_address source;
+                        socklen_t length = sizeof(source);
+                        auto result = ::recvfrom(mSocket, _data, _size, MSG_DONTWAIT, (sockaddr*) &source, &length);
+                        UTIL_NET_STAT(mStats.record_read(result));
+                        if(result < 0 && would_block(errno))
+                            return;
+                        _callback(*this, (int)result, source);
+                    }, nullptr,
+                    [=](){
+                        socket_address none;
+                        memset(&none, 0, sizeof(none));
+                        _callback(*this, completion_result(-pending_error(mSocket)), none);
+                    }
+                ), true);
+            }
+            // fills _batch with as many pending datagrams as fit using a single
+            // recvmmsg(); never blocks and returns 0 when nothing is pending.
+            // Datagrams larger than a slot are cut and flagged as truncated(); with
+            // GRO enabled the slots are first grown to hold a whole coalesced read
+            inline int read_batch(datagram_batch &_batch) {
+                if(mGro)
+                    _batch.reserve_slots(datagram_batch::max_datagram);
+                #if defined(UTIL_NET_HAS_MMSG)
+                    mmsghdr *headers = _batch.prepare(0, _batch.capacity(), true);
+                    int result = ::recvmmsg(mSocket, headers, _batch.capacity(), MSG_DONTWAIT, nullptr);
+                    if(result < 0)
+                    {
+                        UTIL_NET_STAT(mStats.failed());
+                        _batch.clear();
+                        return would_block(errno) ? 0 : -1;
+                    }
+                    _batch.received(result);
+                    UTIL_NET_STAT(for(int i = 0; i < result; i++) mStats.record_read(_batch.length(i)));
+                    return result;
+                #else
+                    _batch.clear();
+                    while(!_batch.full())
+                    {
+                        std::size_t index = _batch.mSize;
+                        iovec vector;
+                        vector.iov_base = _batch.data(index);
+                        vector.iov_len = _batch.slot_size();
+                        msghdr message;
+                        memset(&message, 0, sizeof(message));
+                        message.msg_name = &_batch.mAddresses[index];
+                        message.msg_namelen = sizeof(socket_address);
+                        message.msg_iov = &vector;
+                        message.msg_iovlen = 1;
+                        auto result = ::recvmsg(mSocket, &message, MSG_DONTWAIT);
+                        UTIL_NET_STAT(mStats.record_read(result));
+                        if(result < 0)
+                        {
+                            if(would_block(errno))
+                                break;
+                            return _batch.empty() ? -1 : (int)_batch.size();
+                        }
+                        _batch.mLengths[index] = result;
+                        _batch.mSegments[index] = 0;
+                        _batch.mTruncated[index] = (message.msg_flags & MSG_TRUNC) != 0;
+                        _batch.mSize ++;
+                    }
+                    return _batch.size();
+                #endif
+            }
+            // sends the queued datagrams of _batch with as few sendmmsg() calls as
+            // possible; returns how many went out before the socket would block
+            inline int write_batch(datagram_batch &_batch) {
+                std::size_t sent = 0;
+                while(sent < _batch.size())
+                {
+                    #if defined(UTIL_NET_HAS_MMSG)
+                        mmsghdr *headers = _batch.prepare(sent, _batch.size() - sent, false);
+                        int result = ::sendmmsg(mSocket, headers, _batch.size() - sent, MSG_DONTWAIT);
+                    #else
+                        int result = ::sendto(mSocket, _batch.data(sent), _batch.length(sent), MSG_DONTWAIT,
+                            (sockaddr*) &_batch.mAddresses[sent], sizeof(socket_address));
+                        if(result >= 0)
+                            result = 1;
+                    #endif
+                    if(result < 0)
+                    {
+                        UTIL_NET_STAT(mStats.failed());
+                        if(sent == 0 && !would_block(errno))
+                            return -1;
+                        break;
+                    }
+                    UTIL_NET_STAT(for(int i = 0; i < result; i++) mStats.record_write(_batch.length(sent + i)));
+                    sent += result;
+                }
+                return sent;
+            }
+            // stays armed like read_stream(), but hands over whole batches
+            inline handler_id read_batch_stream(datagram_batch &_batch, std::function<void(udp_client&,datagram_batch&)> _callback) {
+                datagram_batch *batch = &_batch;
+                return mService.add_handler(socket_event_handler(mSocket,
+                    [=](){
+                        if(read_batch(*batch) > 0)
+                            _callback(*this, *batch);
+                    }, nullptr, nullptr
+                ), true);
+            }
+            #if defined(UDP_GRO) && defined(UDP_SEGMENT)
+            // lets the kernel coalesce consecutive datagrams of a flow; see
+            // datagram_batch::segment_size(). A coalesced read can be up to
+            // max_datagram bytes, so read_batch() grows the slots to that size
+            inline bool enable_gro(bool _enable = true) {
+                int value = _enable ? 1 : 0;
+                if(::setsockopt(mSocket, SOL_UDP, UDP_GRO, &value, sizeof(value)) != 0)
+                    return false;
+                mGro = _enable;
+                return true;
+            }
+            // hands _data to the kernel in one call, which splits it into datagrams
+            // of _segment_size bytes (UDP GSO)
+            inline int write_segmented(const char *_data, int _count, int _segment_size, socket_address _target) {
+                iovec vector;
+                vector.iov_base = (void*)_data;
+                vector.iov_len = _count;
+                char control[CMSG_SPACE(sizeof(uint16_t))];
+                memset(control, 0, sizeof(control));
+                msghdr message;
+                memset(&message, 0, sizeof(message));
+                message.msg_name = &_target;
+                message.msg_namelen = sizeof(_target);
+                message.msg_iov = &vector;
+                message.msg_iovlen = 1;
+                message.msg_control = control;
+                message.msg_controllen = sizeof(control);
+                cmsghdr *header = CMSG_FIRSTHDR(&message);
+                header->cmsg_level = SOL_UDP;
+                header->cmsg_type = UDP_SEGMENT;
+                header->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+                uint16_t segment = _segment_size;
+                memcpy(CMSG_DATA(header), &segment, sizeof(segment));
+                auto result = ::sendmsg(mSocket, &message, 0);
+                UTIL_NET_STAT(mStats.record_write(result));
+                return result;
             }
+            #endif
             inline void close() {
+                mService.remove_handlers(mSocket);
                 shutdown_socket(mSocket);
                 ::close(mSocket);
                 mSocket = invalid_socket;
@@ -407,27 +3325,99 @@ namespace util
         protected:
             socket mSocket;
             std::string mIP;
+            bool mGro;
+        };
+        
+        inline bool service_link::post(std::function<void()> _task)
+        {
+            std::lock_guard<std::mutex> lock(mLock);
+            if(mTarget == nullptr)
+                return false;
+            mTarget->post(std::move(_task));
+            return true;
+        }
+        
+        inline bool base_socket::cancel(handler_id _id)
+        {
+            return mService.cancel_handler(_id);
+        }
+        
+        struct listen_options
+        {
+            inline listen_options()
+                : backlog(SOMAXCONN), reuse_port(false), defer_accept(0), fast_open(0) {}
+            int backlog;
+            // several servers may bind the port, the kernel balances between them
+            bool reuse_port;
+            // seconds a connection may wait for its first data before it is
+            // accepted (TCP_DEFER_ACCEPT); 0 accepts right after the handshake
+            int defer_accept;
+            // length of the TCP_FASTOPEN queue; 0 disables fast open
+            int fast_open;
         };
         
         class server : public base_socket
         {
         public:
             inline server(service &_service, int _port) : base_socket(_service), mPort(_port), mSocket(invalid_socket) {}
-            inline server(server &&_move) : base_socket(_move.mService), mSocket(_move.mSocket) {
+            inline server(server &&_move)
+                : base_socket(_move.mService), mPort(_move.mPort), mSocket(_move.mSocket), mAccepted(std::move(_move.mAccepted)) {
                 _move.mSocket = invalid_socket;
             }
             inline ~server() {
+                for(socket accepted : mAccepted)
+                    ::close(accepted);
+                mService.remove_handlers(mSocket);
                 shutdown_socket(mSocket);
                 ::close(mSocket);
                 mSocket = invalid_socket;
             }
-            inline void configure() {
+            // with _reuse_port several servers may bind the same port and the
+            // kernel load-balances incoming connections between them
+            inline void configure(bool _reuse_port = false) {
+                listen_options options;
+                options.reuse_port = _reuse_port;
+                configure(options);
+            }
+            inline void configure(const listen_options &_options) {
                 if(mSocket != invalid_socket)
                     throw socket_exception("server already configured");
                     
-                mSocket = ::socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+                mSocket = create_socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
                 if(mSocket == invalid_socket)
                     __throw_error_with_number("failed to create socket"); 
+                
+                if(_options.reuse_port)
+                {
+                    #if defined(SO_REUSEPORT)
+                        int enable = 1;
+                        if(::setsockopt(mSocket, SOL_SOCKET, SO_REUSEPORT, (char*)&enable, sizeof(enable)) < 0)
+                            __throw_error_with_number("failed to enable SO_REUSEPORT");
+                    #else
+                        throw socket_exception("SO_REUSEPORT is not available on this platform");
+                    #endif
+                }
+                if(_options.defer_accept > 0)
+                {
+                    #if defined(TCP_DEFER_ACCEPT)
+                        int seconds = _options.defer_accept;
+                        if(::setsockopt(mSocket, IPPROTO_TCP, TCP_DEFER_ACCEPT, (char*)&seconds, sizeof(seconds)) < 0)
+                            __throw_error_with_number("failed to enable TCP_DEFER_ACCEPT");
+                    #else
+                        throw socket_exception("TCP_DEFER_ACCEPT is not available on this platform");
+                    #endif
+                }
+                if(_options.fast_open > 0)
+                {
+                    #if defined(TCP_FASTOPEN)
+                        int queue = _options.fast_open;
+                        if(::setsockopt(mSocket, IPPROTO_TCP, TCP_FASTOPEN, (char*)&queue, sizeof(queue)) < 0)
+                            __throw_error_with_number("failed to enable TCP_FASTOPEN");
+                    #else
+                        throw socket_exception("TCP_FASTOPEN is not available on this platform");
+                    #endif
+                }
+                
                 socket_address addr;
                 
                 addr.sin_family = AF_INET;
@@ -438,32 +3428,82 @@ namespace util
                 if(bindResult < 0)
                     __throw_error_with_number("failed to bind server");
                 
-                ::listen(mSocket, SOMAXCONN);
+                if(::listen(mSocket, _options.backlog) < 0)
+                    __throw_error_with_number("failed to listen");
             }
             inline void accept_async(std::function<void(server&,bool)> _callback) {
                 if(!_callback)
                     throw socket_exception("invalid callback passed to accept_async()");
-                mService.add_handler(socket_event_handler(mSocket,
-                    [=](){
-                        _callback(*this, true);
-                    }, nullptr,
-                    [=](){
-                        _callback(*this, false);
+                // the connection is taken off the queue by the service already;
+                // the following accept() call hands it out
+                mService.async_accept(mSocket,
+                    [=](int _result){
+                        UTIL_NET_STAT(_result >= 0 ? mStats.accepted.add() : mStats.errors.add());
+                        if(_result >= 0)
+                            mAccepted.push_back(_result);
+                        _callback(*this, _result >= 0);
                     }
-                ));
+                );
+            }
+            // stays armed until cancel(): every wake-up drains the accept queue (up
+            // to _batch connections, so other sockets get their turn) and hands each
+            // connection to _callback. When descriptors run out the listener pauses
+            // for a moment instead of spinning on the pending connection
+            inline handler_id accept_stream(std::function<void(server&,client&&)> _callback, std::size_t _batch = 256) {
+                if(!_callback)
+                    throw socket_exception("invalid callback passed to accept_stream()");
+                std::shared_ptr<handler_id> id(new handler_id(invalid_handler));
+                *id = mService.add_handler(socket_event_handler(mSocket,
+                    [=](){
+                        for(std::size_t i = 0; i < _batch; i++)
+                        {
+                            socket accepted = accept_socket(mSocket, nullptr, nullptr);
+                            if(accepted != invalid_socket)
+                            {
+                                UTIL_NET_STAT(mStats.accepted.add());
+                                _callback(*this, client(mService, accepted));
+                                continue;
+                            }
+                            UTIL_NET_STAT(mStats.failed());
+                            if(errno == EMFILE || errno == ENFILE || errno == ENOBUFS || errno == ENOMEM)
+                            {
+                                handler_id paused = *id;
+                                service *owner = &mService;
+                                owner->modify_handler(paused, false, false);
+                                owner->add_timer(100, [owner, paused](){
+                                    owner->modify_handler(paused, true, false);
+                                });
+                            }
+                            // aborted handshakes are simply skipped
+                            if(errno != ECONNABORTED && errno != EPROTO && errno != EINTR)
+                                break;
+                        }
+                    }, nullptr, nullptr
+                ), true);
+                return *id;
             }
             inline client accept() {
+                if(!mAccepted.empty())
+                {
+                    socket accepted = mAccepted.front();
+                    mAccepted.pop_front();
+                    return client(mService, accepted);
+                }
                 socket_address addr;
-                auto addr_size = sizeof(addr);
-                socket accepted = ::accept(mSocket, (sockaddr*)&addr, &addr_size);
+                socklen_t addr_size = sizeof(addr);
+                socket accepted = retry_blocking(mSocket, POLLIN, [&](){
+                    return accept_socket(mSocket, (sockaddr*)&addr, &addr_size);
+                });
                 if(accepted == invalid_socket)
                     __throw_error_with_number("failed to accept connection");
+                UTIL_NET_STAT(mStats.accepted.add());
                 return client(mService, accepted);
             }
             inline int port() const { return mPort; }
         private:
             int mPort;
             socket mSocket;
+            std::deque<socket> mAccepted;
         };
 
         class udp_server : public udp_client {
@@ -483,6 +3523,107 @@ namespace util
             int mPort;
             socket_address mAddress;
         };
-    };
-};
 
+        // runs one service per thread; every thread can own a SO_REUSEPORT
+        // listener so accepting scales across cores
+        class service_pool
+        {
+        public:
+            inline service_pool(unsigned int _size = std::thread::hardware_concurrency(),
+                                service_backend _backend = service_backend::automatic,
+                                bool _pin_threads = true)
+                : mPinThreads(_pin_threads), mNext(0) {
+                if(_size < 1)
+                    _size = 1;
+                for(unsigned int i = 0; i < _size; i++)
+                    mServices.emplace_back(new service(_backend));
+            }
+            service_pool(const service_pool&) = delete;
+            service_pool &operator=(const service_pool&) = delete;
+            inline ~service_pool() {
+                stop();
+                join();
+                // listeners have to go while their services are still alive
+                mServers.clear();
+            }
+            inline unsigned int size() const { return mServices.size(); }
+            inline service &at(unsigned int _index) { return *mServices.at(_index); }
+            // round-robin choice of a service, e.g. as target for handoff()
+            inline unsigned int next() {
+                return mNext.fetch_add(1, std::memory_order_relaxed) % mServices.size();
+            }
+            // binds one listener per service; _callback runs on the thread owning
+            // the listener and should accept() the connection, accepting re-arms itself
+            inline void listen(int _port, std::function<void(server&,bool)> _callback) {
+                if(!_callback)
+                    throw socket_exception("invalid callback passed to listen()");
+                for(auto &instance : mServices)
+                {
+                    std::shared_ptr<server> listener(new server(*instance, _port));
+                    listener->configure(true);
+                    mServers.push_back(listener);
+                    
+                    service *owner = instance.get();
+                    owner->post([=](){
+                        accept_loop(listener.get(), _callback);
+                    });
+                }
+            }
+            // moves a connection onto the service _target; _callback receives the
+            // re-bound client on that service's thread
+            inline void handoff(client &_client, unsigned int _target, std::function<void(client&&)> _callback) {
+                socket handle = _client.release();
+                service *target = mServices.at(_target).get();
+                target->post([=](){
+                    _callback(client(*target, handle));
+                });
+            }
+            inline void run() {
+                if(!mThreads.empty())
+                    throw socket_exception("service pool already running");
+                for(unsigned int i = 0; i < mServices.size(); i++)
+                {
+                    service *instance = mServices[i].get();
+                    mThreads.emplace_back([instance](){
+                        instance->run();
+                    });
+                    if(mPinThreads)
+                        pin(mThreads.back(), i);
+                }
+            }
+            inline void stop() {
+                for(auto &instance : mServices)
+                    instance->stop();
+            }
+            inline void join() {
+                for(auto &thread : mThreads)
+                    thread.join();
+                mThreads.clear();
+            }
+        private:
+            static inline void accept_loop(server *_listener, std::function<void(server&,bool)> _callback) {
+                _listener->accept_async([=](server &_server, bool _success){
+                    _callback(_server, _success);
+                    accept_loop(_listener, _callback);
+                });
+            }
+            static inline void pin(std::thread &_thread, unsigned int _index) {
+                #if defined(__linux__)
+                    unsigned int cores = std::thread::hardware_concurrency();
+                    if(cores < 1)
+                        return;
+                    cpu_set_t set;
+                    CPU_ZERO(&set);
+                    CPU_SET(_index % cores, &set);
+                    pthread_setaffinity_np(_thread.native_handle(), sizeof(set), &set);
+                #endif
+            }
+        private:
+            bool mPinThreads;
+            std::atomic<unsigned int> mNext;
+            std::vector<std::unique_ptr<service>> mServices;
+            std::vector<std::shared_ptr<server>> mServers;
+            std::vector<std::thread> mThreads;
+        };
+    };
+};
\ No newline at end of file
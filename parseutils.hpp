@@ -2,10 +2,25 @@
 
 #include <functional>
 #include <stdexcept>
+#include <algorithm>
 #include <istream>
-#include <array>
+#include <cstring>
+#include <exception>
+#include <memory>
+#include <thread>
+#include <atomic>
+#include <vector>
+#include <string_view>
+#include <type_traits>
+#include <limits>
 
 #include "stringutils.hpp"
+#include "fileutils.hpp"
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+	#include <immintrin.h>
+	#define UTIL_PARSE_HAS_X86_SIMD
+#endif
 
 namespace util
 {
@@ -31,26 +46,209 @@ namespace util
 			stream_position mPosition;
 		};
 
+		// Bulk scanning kernels used by reader. Every kernel has a portable
+		// version and, on x86, SSE2 and AVX2 versions; active() picks the
+		// best one the CPU supports the first time it is called.
+		namespace simd
+		{
+			// isspace() in the "C" locale
+			inline bool is_space(char _c) {
+				return (_c == ' ' || (_c >= '\t' && _c <= '\r'));
+			}
+
+			inline const char *skip_space_scalar(const char *_p, const char *_end) {
+				while(_p < _end && is_space(*_p))
+					_p ++;
+				return _p;
+			}
+			inline const char *find_either_scalar(const char *_p, const char *_end, char _a, char _b) {
+				while(_p < _end && *_p != _a && *_p != _b)
+					_p ++;
+				return _p;
+			}
+			inline std::size_t count_scalar(const char *_p, const char *_end, char _c) {
+				std::size_t result = 0;
+				for(; _p < _end; _p++)
+					result += (*_p == _c);
+				return result;
+			}
+
+		#ifdef UTIL_PARSE_HAS_X86_SIMD
+			__attribute__((target("sse2")))
+			inline const char *skip_space_sse2(const char *_p, const char *_end) {
+				const __m128i space = _mm_set1_epi8(' ');
+				const __m128i low = _mm_set1_epi8('\t' - 1);
+				const __m128i high = _mm_set1_epi8('\r' + 1);
+				for(; _end - _p >= 16; _p += 16) {
+					__m128i c = _mm_loadu_si128((const __m128i*)_p);
+					__m128i ws = _mm_or_si128(_mm_cmpeq_epi8(c, space),
+						_mm_and_si128(_mm_cmpgt_epi8(c, low), _mm_cmplt_epi8(c, high)));
+					unsigned mask = ~(unsigned)_mm_movemask_epi8(ws) & 0xffff;
+					if(mask)
+						return _p + __builtin_ctz(mask);
+				}
+				return skip_space_scalar(_p, _end);
+			}
+			__attribute__((target("sse2")))
+			inline const char *find_either_sse2(const char *_p, const char *_end, char _a, char _b) {
+				const __m128i a = _mm_set1_epi8(_a);
+				const __m128i b = _mm_set1_epi8(_b);
+				for(; _end - _p >= 16; _p += 16) {
+					__m128i c = _mm_loadu_si128((const __m128i*)_p);
+					unsigned mask = (unsigned)_mm_movemask_epi8(
+						_mm_or_si128(_mm_cmpeq_epi8(c, a), _mm_cmpeq_epi8(c, b)));
+					if(mask)
+						return _p + __builtin_ctz(mask);
+				}
+				return find_either_scalar(_p, _end, _a, _b);
+			}
+			__attribute__((target("sse2")))
+			inline std::size_t count_sse2(const char *_p, const char *_end, char _c) {
+				const __m128i needle = _mm_set1_epi8(_c);
+				std::size_t result = 0;
+				for(; _end - _p >= 16; _p += 16) {
+					__m128i c = _mm_loadu_si128((const __m128i*)_p);
+					result += __builtin_popcount((unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(c, needle)));
+				}
+				return result + count_scalar(_p, _end, _c);
+			}
+
+			__attribute__((target("avx2")))
+			inline const char *skip_space_avx2(const char *_p, const char *_end) {
+				const __m256i space = _mm256_set1_epi8(' ');
+				const __m256i low = _mm256_set1_epi8('\t' - 1);
+				const __m256i high = _mm256_set1_epi8('\r' + 1);
+				for(; _end - _p >= 32; _p += 32) {
+					__m256i c = _mm256_loadu_si256((const __m256i*)_p);
+					__m256i ws = _mm256_or_si256(_mm256_cmpeq_epi8(c, space),
+						_mm256_and_si256(_mm256_cmpgt_epi8(c, low), _mm256_cmpgt_epi8(high, c)));
+					unsigned mask = ~(unsigned)_mm256_movemask_epi8(ws);
+					if(mask)
+						return _p + __builtin_ctz(mask);
+				}
+				return skip_space_scalar(_p, _end);
+			}
+			__attribute__((target("avx2")))
+			inline const char *find_either_avx2(const char *_p, const char *_end, char _a, char _b) {
+				const __m256i a = _mm256_set1_epi8(_a);
+				const __m256i b = _mm256_set1_epi8(_b);
+				for(; _end - _p >= 32; _p += 32) {
+					__m256i c = _mm256_loadu_si256((const __m256i*)_p);
+					unsigned mask = (unsigned)_mm256_movemask_epi8(
+						_mm256_or_si256(_mm256_cmpeq_epi8(c, a), _mm256_cmpeq_epi8(c, b)));
+					if(mask)
+						return _p + __builtin_ctz(mask);
+				}
+				return find_either_scalar(_p, _end, _a, _b);
+			}
+			__attribute__((target("avx2")))
+			inline std::size_t count_avx2(const char *_p, const char *_end, char _c) {
+				const __m256i needle = _mm256_set1_epi8(_c);
+				std::size_t result = 0;
+				for(; _end - _p >= 32; _p += 32) {
+					__m256i c = _mm256_loadu_si256((const __m256i*)_p);
+					result += __builtin_popcount((unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(c, needle)));
+				}
+				return result + count_scalar(_p, _end, _c);
+			}
+		#endif
+
+			struct kernels
+			{
+				// first character in [_p, _end) that is not whitespace
+				const char *(*skip_space)(const char *_p, const char *_end);
+				// first occurrence of _a or _b in [_p, _end)
+				const char *(*find_either)(const char *_p, const char *_end, char _a, char _b);
+				// occurrences of _c in [_p, _end)
+				std::size_t (*count)(const char *_p, const char *_end, char _c);
+			};
+
+			inline kernels detect() {
+			#ifdef UTIL_PARSE_HAS_X86_SIMD
+				__builtin_cpu_init();
+				if(__builtin_cpu_supports("avx2"))
+					return { skip_space_avx2, find_either_avx2, count_avx2 };
+				if(__builtin_cpu_supports("sse2"))
+					return { skip_space_sse2, find_either_sse2, count_sse2 };
+			#endif
+				return { skip_space_scalar, find_either_scalar, count_scalar };
+			}
+			inline const kernels &active() {
+				static const kernels result = detect();
+				return result;
+			}
+		};
+
+		// moves _position past the characters in [_begin, _end)
+		inline void advance_position(stream_position &_position, const char *_begin, const char *_end) {
+			std::size_t lines = simd::active().count(_begin, _end, '\n');
+			if(lines == 0) {
+				_position.column += (int)(_end - _begin);
+			} else {
+				const char *last = _end;
+				while(last[-1] != '\n')
+					last --;
+				_position.line_number += (int)lines;
+				_position.column = 1 + (int)(_end - last);
+			}
+		}
+
 		class reader
 		{
 		public:
+			// bytes pulled from the stream per refill
+			static constexpr std::size_t block_size = 16384;
+			// characters that can always be put back, even right after a refill
+			static constexpr std::size_t pushback_size = 64;
+
 			inline reader(std::istream &_stream)
-				: mStream(_stream), mPosition{1,1} {}
+				: mStream(&_stream), mPosition{1,1},
+				  mBlock(new char[pushback_size + block_size]),
+				  mCapacity(pushback_size + block_size),
+				  mData(mBlock.get()), mCursor(pushback_size), mEnd(pushback_size),
+				  mLazy(false), mTracked(pushback_size) {}
+			// parses memory in place; _data has to outlive the reader. _start
+			// is the position of _data within a larger input, if it is a part.
+			inline reader(const char *_data, std::size_t _size, const stream_position &_start = {1,1})
+				: mStream(nullptr), mPosition(_start), mCapacity(0),
+				  mData(_data), mCursor(0), mEnd(_size), mLazy(false), mTracked(0) {}
+		#ifdef UTIL_FILE_HAS_MMAP
+			// takes over a mapped file and parses it in place
+			inline reader(file::mapping &&_file)
+				: mStream(nullptr), mPosition{1,1}, mCapacity(0), mFile(std::move(_file)),
+				  mData(mFile.data()), mCursor(0), mEnd(mFile.size()), mLazy(false), mTracked(0) {}
+		#endif
 			inline bool eof() {
 				return _eof();
 			}
 			inline char peek() { return _peek(); }
 			inline char get() {
 				char c = _get();
-				mPosition.column ++;
-				if(c == '\n') {
-					mPosition.column = 1;
-					mPosition.line_number ++;
-				}
+				if(!mLazy)
+					track(c);
 				return c;
 			}
+			// In lazy mode only the byte offset is maintained while reading;
+			// line and column are counted up from the last known position
+			// whenever they are asked for (including by error()).
+			inline void lazy_positions(bool _lazy) {
+				sync();
+				mLazy = _lazy;
+				mTracked = mCursor;
+			}
+			inline bool lazy_positions() const { return mLazy; }
 			inline void put(char _c) {
-				mBuffer = _c + mBuffer;
+				if(mCursor == 0)
+					error("too many characters put back into the stream");
+				if(mData[mCursor - 1] != _c) {
+					// memory sources are read-only, only what was read can go back
+					if(!mBlock)
+						error(std::string("cannot put back '") + _c + "', it was not read from here");
+					mBlock[mCursor - 1] = _c;
+				}
+				sync();
+				mCursor --;
+				mTracked = mCursor;
 				mPosition.column --;
 				if(_c == '\n') {
 					// no nice way to know correct column value, but
@@ -61,29 +259,47 @@ namespace util
 				}
 			}
 			inline void put(const std::string &_str) {
-				for(auto i = _str.length() - 1; i >= 0; i--)
-					put(_str[i]);
+				for(auto i = _str.length(); i > 0; i--)
+					put(_str[i - 1]);
+			}
+			inline int column() const { return position().column; }
+			inline int linenumber() const { return position().line_number; }
+			inline const stream_position &position() const {
+				sync();
+				return mPosition;
 			}
-			inline int column() const { return mPosition.column; }
-			inline int linenumber() const { return mPosition.line_number; }
-			inline const stream_position &position() const { return mPosition; }
 			inline bool skip_whitespace(bool _eof_allowed=false) {
-				while(!eof() && isspace(peek()))
-					get();
+				while((mCursor < mEnd || load_buffer()) && simd::is_space(mData[mCursor])) {
+					// single separators are the common case, not worth a kernel call
+					if(mCursor + 1 == mEnd || !simd::is_space(mData[mCursor + 1])) {
+						char c = mData[mCursor ++];
+						if(!mLazy)
+							track(c);
+						continue;
+					}
+					const char *stop = simd::active().skip_space(mData + mCursor, mData + mEnd);
+					consume(stop - mData);
+				}
 				if(eof() && !_eof_allowed)
 					error("unexpected end of stream");
 				return eof();
 			}
 			inline bool skip_to_nextline(bool _eof_allowed=false) {
-				while(!eof() && get() != '\n')
-					;
+				while(mCursor < mEnd || load_buffer()) {
+					const char *newline = simd::active().find_either(mData + mCursor, mData + mEnd, '\n', '\n');
+					if(newline != mData + mEnd) {
+						consume(newline + 1 - mData);
+						break;
+					}
+					consume(mEnd);
+				}
 				if(eof() && !_eof_allowed)
 					error("unexpected end of stream");
 				return eof();
 			}
 			inline bool skip_expected(const std::string &_expected, bool _error=true) {
-				int index = 0;
-				while(!eof() && peek() == _expected[index]) {
+				std::size_t index = 0;
+				while(index < _expected.size() && !eof() && peek() == _expected[index]) {
 					index ++;
 					get();
 				}
@@ -91,26 +307,46 @@ namespace util
 					error("expected '" + _expected + "', got: '" + _expected.substr(0, index) + "'");
 				return (index < _expected.size());
 			}
+			// The *_view variants return slices of the input instead of
+			// copies. A slice stays valid until the next call on the reader
+			// (memory sources: for as long as the source itself).
 			inline std::string read_string() {
+				std::string result;
+				std::string_view view = read_string_view(result);
+				if(view.data() != result.data())
+					result.assign(view);
+				return result;
+			}
+			// Unescaping only happens if the literal contains escapes; the
+			// unescaped text then goes into _scratch and the view points there.
+			inline std::string_view read_string_view(std::string &_scratch) {
 				skip_expected("\"");
+				std::size_t start = scan_bulk([](const char *_p, const char *_end) {
+					return simd::active().find_either(_p, _end, '\"', '\\');
+				});
+				if(!eof() && peek() == '\"') {
+					std::string_view result(mData + start, mCursor - start);
+					get();
+					return result;
+				}
+				_scratch.assign(mData + start, mCursor - start);
 				bool escaped = false;
-				std::string result = "";
 				while(!eof() && (escaped || peek() != '\"')) {
 					char c = get();
 					if(!escaped) {
 						if(c == '\\')
 							escaped = true;
 						else
-							result += c;
+							_scratch += c;
 					} else {
 						escaped = false;
 						switch(c) {
-							case '\\': result += '\\'; break;
-							case 't':  result += '\t'; break;
-							case 'n':  result += '\n'; break;
-							case 'r':  result += '\r'; break;
-							case 'a':  result += '\a'; break;
-							case 'f':  result += '\f'; break;
+							case '\\': _scratch += '\\'; break;
+							case 't':  _scratch += '\t'; break;
+							case 'n':  _scratch += '\n'; break;
+							case 'r':  _scratch += '\r'; break;
+							case 'a':  _scratch += '\a'; break;
+							case 'f':  _scratch += '\f'; break;
 							default:
 								error(std::string("unknown escape character: '") + c + "'");
 						}
@@ -119,18 +355,24 @@ namespace util
 				if(eof() || peek() != '\"')
 					error("expected '\"' character at end of string literal");
 				skip_expected("\"");
-				return result;
+				return _scratch;
 			}
 			inline bool peek_match(const std::string &_valid) {
 				return (_valid.find(peek()) != -1);
 			}
 			inline std::string read_integer() {
-				return read_token(isdigit);
+				return std::string(read_integer_view());
+			}
+			inline std::string_view read_integer_view() {
+				return read_token_view([](char _c) { return (_c >= '0' && _c <= '9'); });
 			}
 			inline std::string read_decimal() {
+				return std::string(read_decimal_view());
+			}
+			inline std::string_view read_decimal_view() {
 				bool dot_seen = false;
-				return read_token([=](char _c) mutable -> bool {
-					if(isdigit(_c)) return true;
+				return read_token_view([=](char _c) mutable -> bool {
+					if(_c >= '0' && _c <= '9') return true;
 					if(_c == '.' && !dot_seen) {
 						dot_seen = true;
 						return true;
@@ -139,60 +381,483 @@ namespace util
 				});
 			}
 			inline std::string read_hex(bool _prefix=true) {
+				return std::string(read_hex_view(_prefix));
+			}
+			inline std::string_view read_hex_view(bool _prefix=true) {
 				int progress = 0;
-				return read_token([=](char _c) mutable -> bool {
+				return read_token_view([=](char _c) mutable -> bool {
 					int p = progress++;
 					if(p == 0 && _prefix)
 						return (_c == '0');
 					if(p == 1 && _prefix)
-						return (tolower(_c) == 'x');
+						return (_c == 'x' || _c == 'X');
 					if(_c >= '0' && _c <= '9')
 						return true;
-					if(tolower(_c) >= 'a' && tolower(_c) <= 'f')
+					if((_c >= 'a' && _c <= 'f') || (_c >= 'A' && _c <= 'F'))
 						return true;
 					return false;
 				});
 			}
-			inline std::string read_token(std::function<bool(char)> _validator) {
-				std::string result;
-				while(_validator(peek()))
-					result += get();
+			// the token ends at the first rejected character or at the end of input
+			template<class Validator>
+			inline std::string read_token(Validator _validator) {
+				return std::string(read_token_view(_validator));
+			}
+			template<class Validator>
+			inline std::string_view read_token_view(Validator _validator) {
+				std::size_t start = scan(_validator);
+				return std::string_view(mData + start, mCursor - start);
+			}
+			// Numbers are accumulated straight from the input, without going
+			// through a string. Errors are reported at the start of the number.
+			template<typename T>
+			inline T parse_int() {
+				static_assert(std::is_integral<T>::value, "parse_int needs an integer type");
+				typedef typename std::make_unsigned<T>::type unsigned_type;
+				stream_position where = position();
+				bool negative = false;
+				if(!eof() && (peek() == '-' || peek() == '+'))
+					negative = (get() == '-');
+				if(negative && std::is_unsigned<T>::value)
+					error(where, "expected an unsigned integer");
+				unsigned_type limit = (unsigned_type)std::numeric_limits<T>::max() + (negative ? 1 : 0);
+				unsigned_type value = 0;
+				bool overflow = false;
+				std::size_t start = scan([&](char _c) {
+					if(_c < '0' || _c > '9')
+						return false;
+					unsigned_type digit = (unsigned_type)(_c - '0');
+					if(value > (limit - digit) / 10)
+						overflow = true;
+					else
+						value = value * 10 + digit;
+					return true;
+				});
+				if(mCursor == start)
+					error(where, "expected an integer");
+				if(overflow)
+					error(where, "integer out of range");
+				return (T)(negative ? (unsigned_type)0 - value : value);
+			}
+			template<typename T>
+			inline T parse_hex(bool _prefix=true) {
+				static_assert(std::is_integral<T>::value, "parse_hex needs an integer type");
+				typedef typename std::make_unsigned<T>::type unsigned_type;
+				stream_position where = position();
+				if(_prefix && (skip_expected("0", false) || (skip_expected("x", false) && skip_expected("X", false))))
+					error(where, "expected a hexadecimal number starting with '0x'");
+				unsigned_type limit = (unsigned_type)std::numeric_limits<T>::max();
+				unsigned_type value = 0;
+				bool overflow = false;
+				std::size_t start = scan([&](char _c) {
+					unsigned_type digit;
+					if(_c >= '0' && _c <= '9')
+						digit = (unsigned_type)(_c - '0');
+					else if(_c >= 'a' && _c <= 'f')
+						digit = (unsigned_type)(_c - 'a' + 10);
+					else if(_c >= 'A' && _c <= 'F')
+						digit = (unsigned_type)(_c - 'A' + 10);
+					else
+						return false;
+					if(value > (limit - digit) / 16)
+						overflow = true;
+					else
+						value = value * 16 + digit;
+					return true;
+				});
+				if(mCursor == start)
+					error(where, "expected a hexadecimal number");
+				if(overflow)
+					error(where, "hexadecimal number out of range");
+				return (T)value;
+			}
+			// [+-]digits[.digits][(e|E)[+-]digits]; either side of the dot
+			// may be empty, but not both
+			template<typename T>
+			inline T parse_float() {
+				static_assert(std::is_floating_point<T>::value, "parse_float needs a floating point type");
+				stream_position where = position();
+				int state = 0;
+				bool digits = false;
+				std::size_t start = scan([&](char _c) {
+					bool digit = (_c >= '0' && _c <= '9');
+					switch(state) {
+						case 0:
+							state = 1;
+							if(_c == '-' || _c == '+')
+								return true;
+							// fall through
+						case 1:
+							if(_c == '.') {
+								state = 2;
+								return true;
+							}
+							// fall through
+						case 2:
+							if(digit)
+								digits = true;
+							else if((_c == 'e' || _c == 'E') && digits)
+								state = 3;
+							return (digit || state == 3);
+						case 3:
+							state = 4;
+							if(_c == '-' || _c == '+')
+								return true;
+							// fall through
+						case 4:
+							if(digit)
+								state = 5;
+							return digit;
+						default:
+							return digit;
+					}
+				});
+				if(!digits || state == 3 || state == 4)
+					error(where, "expected a floating point number");
+				T result = 0;
+				if(!util::string::try_to(std::string_view(mData + start, mCursor - start), result))
+					error(where, "floating point number out of range");
 				return result;
 			}
 			inline void error(const std::string &_message) {
-				throw exception(mPosition, _message);
+				error(position(), _message);
+			}
+			inline void error(const stream_position &_where, const std::string &_message) {
+				throw exception(_where, _message);
 			}
 		private:
+			inline void track(char _c) {
+				mPosition.column ++;
+				if(_c == '\n') {
+					mPosition.column = 1;
+					mPosition.line_number ++;
+				}
+			}
+			// Consumes characters while _validator accepts them and returns
+			// where they start. Refills keep them in the buffer, so they can
+			// be handed out as one contiguous slice.
+			template<class Validator>
+			inline std::size_t scan(Validator &&_validator) {
+				std::size_t start = mCursor;
+				while(true) {
+					if(mCursor == mEnd) {
+						std::size_t length = mCursor - start;
+						bool more = load_buffer(start);
+						start = mCursor - length;
+						if(!more)
+							break;
+					}
+					char c = mData[mCursor];
+					if(!_validator(c))
+						break;
+					mCursor ++;
+					if(!mLazy)
+						track(c);
+				}
+				return start;
+			}
+			// like scan(), but _find returns where to stop within [_p, _end)
+			// and positions are updated in bulk
+			template<class Finder>
+			inline std::size_t scan_bulk(Finder &&_find) {
+				std::size_t start = mCursor;
+				while(true) {
+					if(mCursor == mEnd) {
+						std::size_t length = mCursor - start;
+						bool more = load_buffer(start);
+						start = mCursor - length;
+						if(!more)
+							break;
+					}
+					const char *stop = _find(mData + mCursor, mData + mEnd);
+					consume(stop - mData);
+					if(stop != mData + mEnd)
+						break;
+				}
+				return start;
+			}
+			// moves the cursor to _to, counting the newlines in between
+			inline void consume(std::size_t _to) {
+				if(!mLazy)
+					count_position(mCursor, _to);
+				mCursor = _to;
+			}
+			inline void count_position(std::size_t _from, std::size_t _to) const {
+				advance_position(mPosition, mData + _from, mData + _to);
+			}
+			// brings a lazily tracked position up to the cursor
+			inline void sync() const {
+				if(mLazy && mTracked < mCursor) {
+					count_position(mTracked, mCursor);
+					mTracked = mCursor;
+				}
+			}
 			inline char _get() {
 				char result = _peek();
-				mBuffer = mBuffer.substr(1);
+				mCursor ++;
 				return result;
 			}
 			inline char _peek() {
-				char result = '\0';
-				if(mBuffer.empty() && !mStream.eof()) {
-					load_buffer();
-				}
-				if(mBuffer.empty())
+				if(mCursor == mEnd && !load_buffer())
 					error("attempted to read beyond end of file");
-				result = mBuffer.at(0);
-				return result;
+				return mData[mCursor];
 			}
 			inline bool _eof() {
-				if(mBuffer.empty())
-					load_buffer();
-				return (mBuffer.empty());
+				return (mCursor == mEnd && !load_buffer());
+			}
+			inline bool load_buffer() {
+				return load_buffer(mCursor);
 			}
-			inline void load_buffer() {
-				std::array<char, 1024> buffer;
-				auto read = mStream.readsome(buffer.data(), 1024);
+			// Only called once everything in the block has been consumed.
+			// Whatever was read since _mark is retained, and so is the tail
+			// in front of it, so that put() keeps working across the refill.
+			// The block only grows when a single token outgrows it.
+			inline bool load_buffer(std::size_t _mark) {
+				if(!mStream)
+					return false;
+				// the characters counted from are about to move
+				sync();
+				std::size_t keep = std::min(_mark, pushback_size);
+				std::size_t retain = mEnd - _mark;
+				std::size_t needed = pushback_size + retain + block_size;
+				if(needed > mCapacity) {
+					std::unique_ptr<char[]> block(new char[std::max(needed, mCapacity * 2)]);
+					std::memcpy(block.get() + pushback_size - keep, mData + _mark - keep, keep + retain);
+					mCapacity = std::max(needed, mCapacity * 2);
+					mBlock = std::move(block);
+					mData = mBlock.get();
+				} else {
+					std::memmove(mBlock.get() + pushback_size - keep, mData + _mark - keep, keep + retain);
+				}
+				mCursor = mEnd = pushback_size + retain;
+				mTracked = mCursor;
+				char *target = mBlock.get() + mEnd;
+				// readsome only hands out what the stream has already buffered,
+				// which is nothing for a file stream that was not touched yet
+				auto read = mStream->readsome(target, block_size);
+				if(read <= 0 && mStream->peek() != std::char_traits<char>::eof())
+					read = mStream->readsome(target, block_size);
 				if(read > 0)
-					mBuffer += std::string(buffer.data(), read);
+					mEnd += read;
+				return (mCursor != mEnd);
 			}
 		private:
-			std::string mBuffer;
-			std::istream &mStream;
+			std::istream *mStream;
+			mutable stream_position mPosition;
+			// storage for stream sources, unused when parsing memory
+			std::unique_ptr<char[]> mBlock;
+			std::size_t mCapacity;
+		#ifdef UTIL_FILE_HAS_MMAP
+			file::mapping mFile;
+		#endif
+			const char *mData;
+			std::size_t mCursor;
+			std::size_t mEnd;
+			bool mLazy;
+			// in lazy mode, the buffer offset mPosition refers to
+			mutable std::size_t mTracked;
+		};
+
+		// Push-style counterpart of reader for input that arrives in pieces,
+		// e.g. from util::net::client::read_async. Data goes in through
+		// prepare()/commit() (read straight into the buffer) or feed();
+		// complete records and tokens come out as views. When a record or
+		// token is still incomplete the call returns false and remembers how
+		// far it got, so the next call continues there instead of scanning
+		// the buffered bytes again.
+		//
+		// Views stay valid until the next prepare() or feed().
+		class push_reader
+		{
+		public:
+			inline push_reader(std::size_t _capacity=16384)
+				: mBuffer(_capacity), mBegin(0), mScanned(0), mEnd(0),
+				  mScanning(scan_none), mFinished(false),
+				  mPosition{1,1}, mTokenPosition{1,1} {}
+
+			// writable space for at least _size more bytes
+			inline char *prepare(std::size_t _size) {
+				if(mBuffer.size() - mEnd < _size) {
+					// drop what was consumed, grow only if that is not enough
+					std::memmove(mBuffer.data(), mBuffer.data() + mBegin, mEnd - mBegin);
+					mScanned -= mBegin;
+					mEnd -= mBegin;
+					mBegin = 0;
+					if(mBuffer.size() - mEnd < _size)
+						mBuffer.resize(std::max(mEnd + _size, mBuffer.size() * 2));
+				}
+				return mBuffer.data() + mEnd;
+			}
+			// makes _size bytes written to prepare()'s buffer available
+			inline void commit(std::size_t _size) {
+				mEnd += _size;
+			}
+			inline void feed(const char *_data, std::size_t _size) {
+				std::memcpy(prepare(_size), _data, _size);
+				commit(_size);
+			}
+			// no more input follows; a trailing partial record or token is
+			// then handed out as complete
+			inline void finish() { mFinished = true; }
+			inline bool finished() const { return mFinished; }
+			// bytes received but not consumed yet
+			inline std::size_t buffered() const { return (mEnd - mBegin); }
+			// position of the next unconsumed byte
+			inline const stream_position &position() const { return mPosition; }
+			// where the record or token returned last started
+			inline const stream_position &token_position() const { return mTokenPosition; }
+
+			// Next record up to _delimiter, which is consumed but not part of
+			// the view. Parse it further with record_reader().
+			inline bool next_record(std::string_view &_record, char _delimiter='\n') {
+				resume(scan_record);
+				const char *data = mBuffer.data();
+				const char *found = simd::active().find_either(data + mScanned, data + mEnd, _delimiter, _delimiter);
+				if(found != data + mEnd) {
+					_record = std::string_view(data + mBegin, found - (data + mBegin));
+					consume(found + 1 - data);
+					return true;
+				}
+				mScanned = mEnd;
+				if(!mFinished || mBegin == mEnd)
+					return false;
+				_record = std::string_view(data + mBegin, mEnd - mBegin);
+				consume(mEnd);
+				return true;
+			}
+			// Next run of characters accepted by _validator, which may be
+			// empty, as with reader::read_token_view(). The validator sees
+			// every byte once, also across calls that return false, so a
+			// stateful one has to be the same object on each attempt. False
+			// after finish() once everything was consumed.
+			template<class Validator>
+			inline bool next_token(std::string_view &_token, Validator &&_validator) {
+				resume(scan_token);
+				const char *data = mBuffer.data();
+				while(mScanned < mEnd && _validator(data[mScanned]))
+					mScanned ++;
+				if(mScanned == mEnd && (!mFinished || mBegin == mEnd))
+					return false;
+				_token = std::string_view(data + mBegin, mScanned - mBegin);
+				consume(mScanned);
+				return true;
+			}
+			// true once a non-whitespace character is available
+			inline bool skip_whitespace() {
+				resume(scan_none);
+				const char *data = mBuffer.data();
+				consume(simd::active().skip_space(data + mBegin, data + mEnd) - data);
+				mTokenPosition = mPosition;
+				return (mBegin != mEnd);
+			}
+			// a reader over a record returned by next_record(), with
+			// positions relative to the whole input
+			inline reader record_reader(std::string_view _record) const {
+				return reader(_record.data(), _record.size(), mTokenPosition);
+			}
+			inline void error(const std::string &_message) {
+				throw exception(mPosition, _message);
+			}
+		private:
+			enum scan_kind { scan_none, scan_record, scan_token };
+
+			// progress only carries over between attempts of the same kind
+			inline void resume(scan_kind _kind) {
+				if(mScanning != _kind)
+					mScanned = mBegin;
+				mScanning = _kind;
+			}
+			inline void consume(std::size_t _to) {
+				mTokenPosition = mPosition;
+				advance_position(mPosition, mBuffer.data() + mBegin, mBuffer.data() + _to);
+				mBegin = mScanned = _to;
+				mScanning = scan_none;
+			}
+		private:
+			std::vector<char> mBuffer;
+			std::size_t mBegin;
+			std::size_t mScanned;
+			std::size_t mEnd;
+			scan_kind mScanning;
+			bool mFinished;
 			stream_position mPosition;
+			stream_position mTokenPosition;
 		};
+
+		// Parses newline-delimited input on several threads. The input is cut
+		// into chunks that each start at the beginning of a line, _parse is
+		// called with a reader over every chunk, and the results come back in
+		// input order for the caller to merge. Readers start at the correct
+		// global position, so positions and parse::exception refer to the
+		// whole input; if parsing throws, the exception of the earliest
+		// failing chunk is rethrown once all threads are done.
+		template<typename Parser, typename Result = decltype(std::declval<Parser&>()(std::declval<reader&>()))>
+		inline std::vector<Result> parse_parallel(const char *_data, std::size_t _size, Parser _parse,
+			unsigned _threads=std::thread::hardware_concurrency(), std::size_t _min_chunk=1 << 20)
+		{
+			_threads = std::max(_threads, 1u);
+			// a few chunks per thread, so uneven chunks still balance out
+			std::size_t count = std::max<std::size_t>(1, std::min<std::size_t>(_threads * 4, _size / std::max<std::size_t>(_min_chunk, 1)));
+			std::vector<std::size_t> bounds(1, 0);
+			for(std::size_t i = 1; i < count; i++) {
+				std::size_t cut = std::max(_size / count * i, bounds.back());
+				const char *newline = simd::active().find_either(_data + cut, _data + _size, '\n', '\n');
+				cut = std::min<std::size_t>(newline - _data + 1, _size);
+				if(cut > bounds.back() && cut < _size)
+					bounds.push_back(cut);
+			}
+			bounds.push_back(_size);
+			count = bounds.size() - 1;
+
+			std::vector<stream_position> starts(count, stream_position{1,1});
+			std::vector<Result> results(count);
+			std::vector<std::exception_ptr> errors(count);
+			auto run = [&](auto _work) {
+				std::atomic<std::size_t> next(0);
+				auto worker = [&]() {
+					for(std::size_t i; (i = next++) < count; )
+						_work(i);
+				};
+				std::vector<std::thread> threads;
+				for(unsigned i = 1; i < std::min<std::size_t>(_threads, count); i++)
+					threads.emplace_back(worker);
+				worker();
+				for(auto &thread : threads)
+					thread.join();
+			};
+			// first pass only counts lines, to know where each chunk starts
+			std::vector<std::size_t> lines(count, 0);
+			run([&](std::size_t _chunk) {
+				if(_chunk + 1 < count)
+					lines[_chunk] = simd::active().count(_data + bounds[_chunk], _data + bounds[_chunk + 1], '\n');
+			});
+			for(std::size_t i = 1; i < count; i++)
+				starts[i].line_number = starts[i - 1].line_number + (int)lines[i - 1];
+			run([&](std::size_t _chunk) {
+				try {
+					reader source(_data + bounds[_chunk], bounds[_chunk + 1] - bounds[_chunk], starts[_chunk]);
+					results[_chunk] = _parse(source);
+				} catch(...) {
+					errors[_chunk] = std::current_exception();
+				}
+			});
+			for(auto &error : errors)
+				if(error)
+					std::rethrow_exception(error);
+			return results;
+		}
+
+	#ifdef UTIL_FILE_HAS_MMAP
+		template<typename Parser, typename Result = decltype(std::declval<Parser&>()(std::declval<reader&>()))>
+		inline std::vector<Result> parse_file_parallel(const std::string &_path, Parser _parse,
+			unsigned _threads=std::thread::hardware_concurrency(), std::size_t _min_chunk=1 << 20)
+		{
+			// chunks are read concurrently, so no sequential read-ahead hint
+			file::mapping input(_path, false);
+			if(!input.is_open())
+				throw std::runtime_error("cannot open '" + _path + "'");
+			return parse_parallel(input.data(), input.size(), _parse, _threads, _min_chunk);
+		}
+	#endif
 	};
-};
+};
\ No newline at end of file
@@ -1,11 +1,24 @@
 #pragma once
 
 #include <algorithm>
+#include <stdexcept>
+#include <type_traits>
+#include <string_view>
+#include <charconv>
+#include <iterator>
+#include <cstddef>
+#include <cstdint>
 #include <vector>
 #include <string>
+#include <sstream>
 
 #include "listutils.hpp"
 
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+    #include <immintrin.h>
+    #define UTIL_STRING_HAS_X86_SIMD
+#endif
+
 namespace util
 {
     typedef std::vector<std::string> string_vector;
@@ -46,17 +59,365 @@ namespace util
             return result;
         }
         
+        // Lazy, allocation-free counterpart of split(): iterating yields the
+        // tokens as views into _text, which has to outlive the range (so do
+        // not pass a temporary std::string).
+        class split_view
+        {
+        public:
+            class iterator
+            {
+            public:
+                typedef std::forward_iterator_tag iterator_category;
+                typedef std::string_view value_type;
+                typedef std::ptrdiff_t difference_type;
+                typedef const std::string_view *pointer;
+                typedef const std::string_view &reference;
+                
+                inline iterator()
+                    : mNext(std::string_view::npos), mRemoveEmpty(true), mDone(true) {}
+                inline iterator(std::string_view _text, std::string_view _seperator, bool _removeEmpty)
+                    : mText(_text), mSeperator(_seperator), mNext(0),
+                      mRemoveEmpty(_removeEmpty), mDone(false)
+                {
+                    advance();
+                }
+                
+                inline reference operator*() const { return mToken; }
+                inline pointer operator->() const { return &mToken; }
+                inline iterator &operator++()
+                {
+                    advance();
+                    return *this;
+                }
+                inline iterator operator++(int)
+                {
+                    iterator result = *this;
+                    advance();
+                    return result;
+                }
+                inline bool operator==(const iterator &_other) const
+                {
+                    return (mDone == _other.mDone && (mDone || mToken.data() == _other.mToken.data()));
+                }
+                inline bool operator!=(const iterator &_other) const { return !(*this == _other); }
+                
+            private:
+                inline std::string::size_type find() const
+                {
+                    // an empty separator never matches, as there would be no progress
+                    if(mSeperator.empty())
+                        return std::string_view::npos;
+                    if(mSeperator.size() == 1)
+                        return mText.find(mSeperator[0], mNext);
+                    return mText.find(mSeperator, mNext);
+                }
+                inline void advance()
+                {
+                    while(true)
+                    {
+                        if(mNext == std::string_view::npos)
+                        {
+                            mDone = true;
+                            return;
+                        }
+                        
+                        std::string::size_type pos = find();
+                        
+                        if(pos == std::string_view::npos)
+                        {
+                            mToken = mText.substr(mNext);
+                            mNext = std::string_view::npos;
+                        }
+                        else
+                        {
+                            mToken = mText.substr(mNext, pos - mNext);
+                            mNext = pos + mSeperator.size();
+                        }
+                        
+                        if(!mToken.empty() || !mRemoveEmpty)
+                            return;
+                    }
+                }
+                
+                std::string_view mText;
+                std::string_view mSeperator;
+                std::string_view mToken;
+                std::string::size_type mNext;
+                bool mRemoveEmpty;
+                bool mDone;
+            };
+            
+            inline split_view(std::string_view _text,
+                              std::string_view _seperator = " ",
+                              bool _removeEmpty = true)
+                : mText(_text), mSeperator(_seperator), mRemoveEmpty(_removeEmpty) {}
+            
+            inline iterator begin() const { return iterator(mText, mSeperator, mRemoveEmpty); }
+            inline iterator end() const { return iterator(); }
+            
+        private:
+            std::string_view mText;
+            std::string_view mSeperator;
+            bool mRemoveEmpty;
+        };
+        
+        namespace internal
+        {
+            struct delimiter_set
+            {
+                char chars[16];
+                int count;
+                bool table[256];
+                char quote;
+                bool quoted;
+            };
+            
+            // Classifiers for one 64 byte block: bit i of _delimiters/_quotes
+            // is set when byte i is a delimiter/the quote character.
+            inline void classify_scalar(const delimiter_set &_set, const char *_block,
+                                        std::uint64_t &_delimiters, std::uint64_t &_quotes)
+            {
+                std::uint64_t delimiters = 0, quotes = 0;
+                for(int i = 0; i < 64; i++)
+                {
+                    delimiters |= (std::uint64_t)_set.table[(unsigned char)_block[i]] << i;
+                    quotes |= (std::uint64_t)(_set.quoted && _block[i] == _set.quote) << i;
+                }
+                _delimiters = delimiters;
+                _quotes = quotes;
+            }
+            
+        #ifdef UTIL_STRING_HAS_X86_SIMD
+            __attribute__((target("sse4.2")))
+            inline void classify_sse42(const delimiter_set &_set, const char *_block,
+                                       std::uint64_t &_delimiters, std::uint64_t &_quotes)
+            {
+                const __m128i set = _mm_loadu_si128((const __m128i*)_set.chars);
+                const __m128i quote = _mm_set1_epi8(_set.quote);
+                std::uint64_t delimiters = 0, quotes = 0;
+                for(int i = 0; i < 4; i++)
+                {
+                    __m128i bytes = _mm_loadu_si128((const __m128i*)(_block + 16 * i));
+                    // explicit lengths, so NUL bytes in the text are not terminators
+                    if(_set.count > 0)
+                    {
+                        __m128i found = _mm_cmpestrm(set, _set.count, bytes, 16,
+                            _SIDD_UBYTE_OPS | _SIDD_CMP_EQUAL_ANY | _SIDD_BIT_MASK);
+                        delimiters |= (std::uint64_t)(std::uint16_t)_mm_cvtsi128_si32(found) << (16 * i);
+                    }
+                    if(_set.quoted)
+                        quotes |= (std::uint64_t)(std::uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, quote)) << (16 * i);
+                }
+                _delimiters = delimiters;
+                _quotes = quotes;
+            }
+            
+            __attribute__((target("avx2")))
+            inline void classify_avx2(const delimiter_set &_set, const char *_block,
+                                      std::uint64_t &_delimiters, std::uint64_t &_quotes)
+            {
+                const __m256i low = _mm256_loadu_si256((const __m256i*)_block);
+                const __m256i high = _mm256_loadu_si256((const __m256i*)(_block + 32));
+                __m256i low_found = _mm256_setzero_si256();
+                __m256i high_found = _mm256_setzero_si256();
+                for(int i = 0; i < _set.count; i++)
+                {
+                    __m256i delimiter = _mm256_set1_epi8(_set.chars[i]);
+                    low_found = _mm256_or_si256(low_found, _mm256_cmpeq_epi8(low, delimiter));
+                    high_found = _mm256_or_si256(high_found, _mm256_cmpeq_epi8(high, delimiter));
+                }
+                _delimiters = (std::uint64_t)(std::uint32_t)_mm256_movemask_epi8(low_found)
+                    | (std::uint64_t)(std::uint32_t)_mm256_movemask_epi8(high_found) << 32;
+                _quotes = 0;
+                if(_set.quoted)
+                {
+                    __m256i quote = _mm256_set1_epi8(_set.quote);
+                    _quotes = (std::uint64_t)(std::uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(low, quote))
+                        | (std::uint64_t)(std::uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(high, quote)) << 32;
+                }
+            }
+        #endif
+            
+            typedef void (*classify_fn)(const delimiter_set&, const char*, std::uint64_t&, std::uint64_t&);
+            
+            inline classify_fn select_classifier()
+            {
+            #ifdef UTIL_STRING_HAS_X86_SIMD
+                __builtin_cpu_init();
+                if(__builtin_cpu_supports("avx2"))
+                    return classify_avx2;
+                if(__builtin_cpu_supports("sse4.2"))
+                    return classify_sse42;
+            #endif
+                return classify_scalar;
+            }
+            
+            inline int lowest_bit(std::uint64_t _bits)
+            {
+            #if defined(__GNUC__) || defined(__clang__)
+                return __builtin_ctzll(_bits);
+            #else
+                int result = 0;
+                while(!(_bits & 1))
+                {
+                    _bits >>= 1;
+                    result++;
+                }
+                return result;
+            #endif
+            }
+            
+            // bit i of the result is the parity of bits 0..i
+            inline std::uint64_t prefix_xor(std::uint64_t _bits)
+            {
+                _bits ^= _bits << 1;
+                _bits ^= _bits << 2;
+                _bits ^= _bits << 4;
+                _bits ^= _bits << 8;
+                _bits ^= _bits << 16;
+                _bits ^= _bits << 32;
+                return _bits;
+            }
+        };
+        
+        // Splits text on any of a set of delimiter characters, 64 bytes at a
+        // time: each block becomes a bitmap of delimiter positions (AVX2 or
+        // SSE4.2 when the CPU has it) from which the field boundaries are
+        // read off. With a quote character, delimiters between quotes do not
+        // count; a doubled quote inside quotes works as an escape. Fields are
+        // not unquoted.
+        class tokenizer
+        {
+        public:
+            static const std::size_t max_delimiters = 16;
+            
+            inline tokenizer(std::string_view _delimiters, char _quote = '\0')
+            {
+                if(_delimiters.size() > max_delimiters)
+                    throw std::invalid_argument("tokenizer supports at most 16 delimiters");
+                std::fill(std::begin(mSet.chars), std::end(mSet.chars), '\0');
+                std::fill(std::begin(mSet.table), std::end(mSet.table), false);
+                std::copy(_delimiters.begin(), _delimiters.end(), mSet.chars);
+                mSet.count = (int)_delimiters.size();
+                for(char delimiter : _delimiters)
+                    mSet.table[(unsigned char)delimiter] = true;
+                mSet.quote = _quote;
+                mSet.quoted = (_quote != '\0');
+                // the tail block is padded with something that matches nothing
+                mPadding = '\0';
+                for(int c = 1; c < 256; c++)
+                {
+                    if(!mSet.table[c] && (char)c != _quote)
+                    {
+                        mPadding = (char)c;
+                        break;
+                    }
+                }
+            }
+            
+            // Writes the offset at which each field of _text ends (its
+            // delimiter, or _text.size() for the last field) to _ends and
+            // returns how many were written. If that is _capacity there may be
+            // more fields: continue with the text after the last end.
+            inline std::size_t tokenize(std::string_view _text, std::size_t *_ends, std::size_t _capacity) const
+            {
+                static const internal::classify_fn classify = internal::select_classifier();
+                std::size_t count = 0;
+                std::uint64_t inside = 0;
+                for(std::size_t base = 0; base < _text.size(); base += 64)
+                {
+                    const char *block = _text.data() + base;
+                    char padded[64];
+                    if(_text.size() - base < 64)
+                    {
+                        std::fill(std::begin(padded), std::end(padded), mPadding);
+                        std::copy(block, _text.data() + _text.size(), padded);
+                        block = padded;
+                    }
+                    
+                    std::uint64_t delimiters, quotes;
+                    classify(mSet, block, delimiters, quotes);
+                    if(mSet.quoted)
+                    {
+                        // quoted regions run from a quote up to the next one;
+                        // the state carries over into the next block
+                        std::uint64_t quoted = internal::prefix_xor(quotes) ^ inside;
+                        inside = (std::uint64_t)0 - (quoted >> 63);
+                        delimiters &= ~quoted;
+                    }
+                    
+                    while(delimiters)
+                    {
+                        if(count == _capacity)
+                            return count;
+                        _ends[count++] = base + internal::lowest_bit(delimiters);
+                        delimiters &= delimiters - 1;
+                    }
+                }
+                if(count < _capacity)
+                    _ends[count++] = _text.size();
+                return count;
+            }
+            
+        private:
+            internal::delimiter_set mSet;
+            char mPadding;
+        };
+        
+        // The separator only goes in front of an element once the joined
+        // text is non-empty, so leading empty elements leave no trace.
+        template<class Iterable>
+        inline std::size_t joined_size(const Iterable &_strings, const std::string &_seperator)
+        {
+            std::size_t size = 0;
+            for(const auto &string : _strings)
+            {
+                if(size > 0)
+                    size += _seperator.size();
+                size += std::string_view(string).size();
+            }
+            return size;
+        }
+        
+        // writes the joined text to _out, which needs room for joined_size() chars
+        template<class Iterable, class OutputIterator>
+        inline OutputIterator join(const Iterable &_strings, const std::string &_seperator, OutputIterator _out)
+        {
+            bool empty = true;
+            for(const auto &string : _strings)
+            {
+                std::string_view text(string);
+                if(!empty)
+                    _out = std::copy(_seperator.begin(), _seperator.end(), _out);
+                _out = std::copy(text.begin(), text.end(), _out);
+                empty = empty && text.empty();
+            }
+            return _out;
+        }
+        
+        // appends the joined text to _out, whose capacity is kept across calls
+        template<class Iterable>
+        inline std::string &join_to(std::string &_out, const Iterable &_strings, const std::string &_seperator)
+        {
+            _out.reserve(_out.size() + joined_size(_strings, _seperator));
+            bool empty = true;
+            for(const auto &string : _strings)
+            {
+                std::string_view text(string);
+                if(!empty)
+                    _out.append(_seperator);
+                _out.append(text.data(), text.size());
+                empty = empty && text.empty();
+            }
+            return _out;
+        }
+        
         template<class Iterable>
         inline std::string join(const Iterable &_strings, const std::string &_seperator)
         {
-            return list::foldl(_strings, std::string(""),
-                [&](const std::string &_acc, const std::string &_next) -> std::string {
-                    if(_acc.empty())
-                        return _next;
-                    else
-                        return _acc + _seperator + _next;
-                }
-            );
+            std::string result;
+            return join_to(result, _strings, _seperator);
         }
         
         inline string_vector from_args(int _argc, char *_argv[])
@@ -77,21 +438,136 @@ namespace util
             return _string.substr(start, end - start);
         }
         
+        // thrown by to() when the text is not a valid T
+        class conversion_error : public std::invalid_argument
+        {
+        public:
+            using std::invalid_argument::invalid_argument;
+        };
+        
+        namespace internal
+        {
+        #ifdef __cpp_lib_to_chars
+            const bool has_floating_chars = true;
+        #else
+            // older libraries only convert integers with from_chars/to_chars
+            const bool has_floating_chars = false;
+        #endif
+            
+            // types that go through from_chars/to_chars; characters are
+            // read and written as characters by streams, so they stay there
+            template<typename T>
+            struct is_number : std::integral_constant<bool,
+                std::is_arithmetic<T>::value
+                && (has_floating_chars || !std::is_floating_point<T>::value)
+                && !std::is_same<T, bool>::value
+                && !std::is_same<T, char>::value
+                && !std::is_same<T, signed char>::value
+                && !std::is_same<T, unsigned char>::value
+                && !std::is_same<T, wchar_t>::value
+                && !std::is_same<T, char16_t>::value
+                && !std::is_same<T, char32_t>::value> {};
+            
+            // same leniency as operator>>: leading whitespace and '+'
+            inline const char *skip_sign(const char *_begin, const char *_end)
+            {
+                while(_begin < _end && isspace((unsigned char)*_begin))
+                    _begin++;
+                if(_end - _begin > 1 && *_begin == '+' && _begin[1] != '-')
+                    _begin++;
+                return _begin;
+            }
+            
+            inline bool only_space(const char *_begin, const char *_end)
+            {
+                while(_begin < _end && isspace((unsigned char)*_begin))
+                    _begin++;
+                return (_begin == _end);
+            }
+            
+            template<typename T>
+            inline bool parse_number(const char *_begin, const char *_end, T &_result)
+            {
+                _begin = skip_sign(_begin, _end);
+                auto parsed = std::from_chars(_begin, _end, _result);
+                return (parsed.ec == std::errc() && only_space(parsed.ptr, _end));
+            }
+        };
+        
+        // Non-throwing conversion. On failure _result is left untouched.
+        // Numbers are parsed with from_chars and must make up the whole
+        // text (surrounding whitespace aside); strings are copied as they
+        // are, empty ones included; other types use operator>>.
+        template<typename T>
+        inline bool try_to(std::string_view _string, T &_result)
+        {
+            if constexpr(internal::is_number<T>::value)
+            {
+                T value;
+                if(!internal::parse_number(_string.data(), _string.data() + _string.size(), value))
+                    return false;
+                _result = value;
+                return true;
+            }
+            else if constexpr(std::is_same<T, bool>::value)
+            {
+                int value;
+                if(!internal::parse_number(_string.data(), _string.data() + _string.size(), value)
+                    || (value != 0 && value != 1))
+                    return false;
+                _result = (value == 1);
+                return true;
+            }
+            else if constexpr(std::is_same<T, std::string>::value || std::is_same<T, std::string_view>::value)
+            {
+                _result = T(_string);
+                return true;
+            }
+            else
+            {
+                std::stringstream convert{std::string(_string)};
+                T value;
+                if(!(convert >> value))
+                    return false;
+                _result = std::move(value);
+                return true;
+            }
+        }
+        
         template<typename T>
         inline T to(const std::string &_string)
         {
-            std::stringstream convert(_string);
-            T result;
-            convert >> result;
+            T result{};
+            if(!try_to(_string, result))
+                throw conversion_error("cannot convert '" + _string + "'");
             return result;
         }
         
         template<typename T>
         inline std::string from(const T &_value)
         {
-            std::stringstream convert;
-            convert << _value;
-            return convert.str();
+            if constexpr(internal::is_number<T>::value)
+            {
+                // large enough for any long double in general format
+                char buffer[64];
+                std::to_chars_result written;
+                if constexpr(std::is_floating_point<T>::value)
+                    // matches the default stream format (%g, precision 6)
+                    written = std::to_chars(buffer, buffer + sizeof(buffer), _value, std::chars_format::general, 6);
+                else
+                    written = std::to_chars(buffer, buffer + sizeof(buffer), _value);
+                return std::string(buffer, written.ptr);
+            }
+            else if constexpr(std::is_same<T, bool>::value)
+            {
+                return (_value ? "1" : "0");
+            }
+            else
+            {
+                std::stringstream convert;
+                convert << _value;
+                return convert.str();
+            }
         }
     };
 };
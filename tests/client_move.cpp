@@ -0,0 +1,63 @@
+// g++ -std=c++17 -pthread -fsanitize=address -I.. client_move.cpp -o client_move && ./client_move
+#include <netutils.hpp>
+#include <cassert>
+#include <memory>
+#include <unistd.h>
+
+using namespace util::net;
+
+int main()
+{
+    int port = 20000 + getpid() % 20000;
+    service events;
+    server listener(events, port);
+    listener.configure();
+    std::unique_ptr<client> peer;
+    listener.accept_async([&](server &_server, bool) { peer.reset(new client(_server.accept())); });
+    
+    client connection(events);
+    assert(connection.connect("127.0.0.1", port));
+    for(int i = 0; i < 20 && !peer; i++)
+        events.do_poll(50);
+    assert(peer);
+    
+    // an armed receive() captures the client, so moving it has to be refused
+    std::string received;
+    handler_id reader = connection.receive([&](client &_client, int _count) {
+        if(_count > 0)
+        {
+            received.resize(_client.received().size());
+            _client.received().read(&received[0], received.size());
+        }
+    });
+    bool refused = false;
+    {
+        try {
+            client moved(std::move(connection));
+        } catch(const socket_exception&) {
+            refused = true;
+        }
+    }
+    assert(refused);
+    assert(connection.handle() != invalid_socket);
+    peer->write("ping");
+    for(int i = 0; i < 20 && received.empty(); i++)
+        events.do_poll(50);
+    assert(received == "ping");
+    
+    // with nothing pending (an idle writer included) the move goes through
+    connection.cancel(reader);
+    connection.send("pong");
+    for(int i = 0; i < 5; i++)
+        events.do_poll(10);
+    char buffer[4];
+    assert(peer->read(buffer, 4) == 4);
+    util::net::socket handle = connection.handle();
+    std::unique_ptr<client> moved(new client(std::move(connection)));
+    assert(moved->handle() == handle && connection.handle() == invalid_socket);
+    moved->send("done");
+    for(int i = 0; i < 5; i++)
+        events.do_poll(10);
+    assert(peer->read(buffer, 4) == 4);
+    return 0;
+}
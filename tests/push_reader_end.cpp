@@ -0,0 +1,34 @@
+// g++ -std=c++17 -fsanitize=address -I.. push_reader_end.cpp -o push_reader_end && ./push_reader_end
+#include <parseutils.hpp>
+#include <cassert>
+#include <cctype>
+
+int main()
+{
+	auto is_word = [](char _c) { return std::isalnum((unsigned char)_c) != 0; };
+	util::parse::push_reader reader;
+	std::string_view token;
+	
+	reader.feed("alpha be", 8);
+	assert(reader.next_token(token, is_word) && token == "alpha");
+	assert(reader.skip_whitespace());
+	// "be" may continue in the next chunk
+	assert(!reader.next_token(token, is_word));
+	
+	reader.feed("ta", 2);
+	reader.finish();
+	assert(reader.next_token(token, is_word) && token == "beta");
+	// nothing is left, so there is no (empty) token either, however often asked
+	assert(!reader.next_token(token, is_word));
+	assert(!reader.next_token(token, is_word));
+	assert(reader.buffered() == 0);
+	
+	// the same with input that ends on a separator
+	util::parse::push_reader trailing;
+	trailing.feed("x ", 2);
+	trailing.finish();
+	assert(trailing.next_token(token, is_word) && token == "x");
+	assert(!trailing.skip_whitespace());
+	assert(!trailing.next_token(token, is_word));
+	return 0;
+}
@@ -0,0 +1,38 @@
+// g++ -std=c++17 -pthread -fsanitize=address -I.. resolver_lifetime.cpp -o resolver_lifetime && ./resolver_lifetime
+#include <netutils.hpp>
+#include <cassert>
+#include <chrono>
+#include <thread>
+
+using namespace util::net;
+
+int main()
+{
+    // nothing is cached (ttl 0), so every name goes to a worker thread,
+    // which has to notice when the service asking for it is gone
+    resolver names(4, 0, 0);
+    int delivered = 0;
+    for(int i = 0; i < 200; i++)
+    {
+        std::unique_ptr<service> events(new service());
+        names.resolve_async(*events, "localhost", AF_UNSPEC, [&](int, const resolver::address_list&) {
+            delivered ++;
+        });
+        if(i % 4 == 0)
+            events->do_poll(10);
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    assert(delivered <= 50);
+    
+    // a service that is still around gets its answer
+    service events;
+    bool answered = false;
+    names.resolve_async(events, "localhost", AF_UNSPEC, [&](int _error, const resolver::address_list &_addresses) {
+        assert(_error == 0 && !_addresses.empty());
+        answered = true;
+    });
+    for(int i = 0; i < 100 && !answered; i++)
+        events.do_poll(20);
+    assert(answered);
+    return 0;
+}
@@ -0,0 +1,121 @@
+// g++ -std=c++17 -O2 -pthread -I.. socket_syscalls.cpp -o socket_syscalls && ./socket_syscalls
+// Linux only: counts the system calls of a loopback echo by tracing itself,
+// the same numbers strace -c -f would report for the measured loops
+#include <netutils.hpp>
+#include <cassert>
+#include <cstdio>
+#include <memory>
+#include <signal.h>
+#include <sys/ptrace.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+using namespace util::net;
+
+const int round_trips = 2000;
+const int message_size = 64;
+
+// getppid() is not used by the library, so it marks where the phases start and end
+void mark()
+{
+    syscall(SYS_getppid);
+}
+
+void echo()
+{
+    int port = 20000 + getpid() % 20000;
+    service events;
+    server listener(events, port);
+    listener.configure();
+    std::unique_ptr<client> peer;
+    listener.accept_async([&](server &_server, bool) { peer.reset(new client(_server.accept())); });
+    client connection(events);
+    if(!connection.connect("127.0.0.1", port))
+        _exit(1);
+    for(int i = 0; i < 20 && !peer; i++)
+        events.do_poll(50);
+    if(!peer)
+        _exit(1);
+
+    char message[message_size] = {}, buffer[message_size];
+    mark();
+    for(int i = 0; i < round_trips; i++)
+    {
+        connection.write(message, message_size);
+        peer->read(buffer, message_size);
+        peer->write(buffer, message_size);
+        connection.read(buffer, message_size);
+    }
+    mark();
+
+    // what every blocking call used to do: switch the mode, then do the I/O
+    mark();
+    for(int i = 0; i < round_trips; i++)
+    {
+        make_blocking(connection.handle());
+        ::send(connection.handle(), message, message_size, 0);
+        make_blocking(peer->handle());
+        ::recv(peer->handle(), buffer, message_size, 0);
+        make_blocking(peer->handle());
+        ::send(peer->handle(), buffer, message_size, 0);
+        make_blocking(connection.handle());
+        ::recv(connection.handle(), buffer, message_size, 0);
+    }
+    mark();
+    _exit(0);
+}
+
+struct phase
+{
+    long calls = 0;
+    long ioctls = 0;
+};
+
+int main()
+{
+    pid_t child = fork();
+    if(child == 0)
+    {
+        ptrace(PTRACE_TRACEME, 0, nullptr, nullptr);
+        raise(SIGSTOP);
+        echo();
+    }
+    int status;
+    waitpid(child, &status, 0);
+    ptrace(PTRACE_SETOPTIONS, child, nullptr, PTRACE_O_TRACESYSGOOD | PTRACE_O_EXITKILL);
+
+    phase phases[2];
+    int marks = 0;
+    for(;;)
+    {
+        ptrace(PTRACE_SYSCALL, child, nullptr, nullptr);
+        waitpid(child, &status, 0);
+        if(WIFEXITED(status) || WIFSIGNALED(status))
+            break;
+        if(!WIFSTOPPED(status) || WSTOPSIG(status) != (SIGTRAP | 0x80))
+            continue;
+        __ptrace_syscall_info info;
+        if(ptrace(PTRACE_GET_SYSCALL_INFO, child, sizeof(info), &info) <= 0 || info.op != PTRACE_SYSCALL_INFO_ENTRY)
+            continue;
+        if(info.entry.nr == SYS_getppid)
+        {
+            marks ++;
+            continue;
+        }
+        if(marks % 2 == 0 || marks > 4)
+            continue;
+        phase &current = phases[marks / 2];
+        current.calls ++;
+        if(info.entry.nr == SYS_ioctl)
+            current.ioctls ++;
+    }
+    assert(WIFEXITED(status) && WEXITSTATUS(status) == 0 && marks == 4);
+
+    printf("system calls per round trip (4 blocking calls):\n");
+    printf("  client::write/read      %.2f (%.2f ioctl)\n", (double)phases[0].calls / round_trips, (double)phases[0].ioctls / round_trips);
+    printf("  ioctl before each call  %.2f (%.2f ioctl)\n", (double)phases[1].calls / round_trips, (double)phases[1].ioctls / round_trips);
+    assert(phases[0].ioctls == 0);
+    assert(phases[0].calls < phases[1].calls);
+    return 0;
+}
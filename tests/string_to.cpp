@@ -0,0 +1,35 @@
+// g++ -std=c++17 -fsanitize=address -I.. string_to.cpp -o string_to && ./string_to
+#include <stringutils.hpp>
+#include <optutils.hpp>
+#include <cassert>
+
+int main()
+{
+    // strings are taken as they are, including empty and spaced ones
+    assert(util::string::to<std::string>("") == "");
+    assert(util::string::to<std::string>("two words") == "two words");
+    std::string text = " padded ";
+    assert(util::string::to<std::string_view>(text) == " padded ");
+    std::string result = "untouched";
+    assert(util::string::try_to("", result) && result.empty());
+    
+    // numbers still have to be complete
+    assert(util::string::to<int>(" 42 ") == 42);
+    bool thrown = false;
+    try
+    {
+        util::string::to<int>("");
+    }
+    catch(const util::string::conversion_error&)
+    {
+        thrown = true;
+    }
+    assert(thrown);
+    
+    // an option passed with an empty argument
+    util::opt::option name("name", true, true);
+    util::opt::passed_option passed(name, "");
+    assert(passed.get_as<std::string>() == "");
+    assert(passed.get_as<std::string>("fallback") == "fallback");
+    return 0;
+}